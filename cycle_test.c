@@ -110,21 +110,23 @@ void compute_grid_graph(grid_graph_t gg) {
   zdd_set_vmax(gg->ecount);
 
   // Construct ZDD of all simple loops. See Knuth.
-  memo_t node_tab[zdd_vmax() + 1];
-  for(uint16_t v = 1; v <= zdd_vmax(); v++) memo_init(node_tab[v]);
+  // One table of nodes for each edge.
+  memo_t *node_tab = malloc(sizeof(*node_tab) * (zdd_vmax() + 1));
+  for(uint32_t v = 1; v <= zdd_vmax(); v++) memo_init(node_tab[v]);
 
-  uint32_t unique(uint16_t v, uint32_t lo, uint32_t hi) {
+  zdd_id_t unique(uint32_t v, zdd_id_t lo, zdd_id_t hi) {
     // Create or return existing node representing !v ? lo : hi.
-    uint32_t key[2] = { lo, hi };
+    zdd_id_t key[2] = { lo, hi };
     memo_it it;
-    int just_created = memo_it_insert_u(&it, node_tab[v], (void *) key, 8);
+    int just_created = memo_it_insert_u(&it, node_tab[v], (void *) key,
+					 sizeof(key));
     if (just_created) {
-      uint32_t r;
-      memo_it_put(it, (void *) (r = zdd_abs_node(v, lo, hi)));
-      if (!(r << 15)) printf("node #%x\n", r);
+      zdd_id_t r;
+      memo_it_put(it, (void *) (uintptr_t) (r = zdd_abs_node(v, lo, hi)));
+      if (!(r & 0x1ffff)) printf("node #%lx\n", (unsigned long) r);
       return r;
     }
-    return (uint32_t) memo_it_data(it);
+    return (zdd_id_t) (uintptr_t) memo_it_data(it);
   }
 
   int max = gg->vcount;
@@ -150,14 +152,16 @@ void compute_grid_graph(grid_graph_t gg) {
   // in our state. Thus, in the state:
   //   -1 means we've already picked two edges involving this vertex
   //    n means the other end is n + au[e] - 1
-  memo_t cache[zdd_vmax() + 1];
+  memo_t *cache = malloc(sizeof(*cache) * (zdd_vmax() + 1));
   for(int i = 0; i <= zdd_vmax(); i++) memo_init(cache[i]);
-  uint32_t recurse(int e, char *state, int start, int count) {
+  zdd_id_t recurse(int e, char *state, int start, int count) {
     char newstate[max + 1];
     int newcount = 0;
     memo_it it = NULL;
-    uint32_t memoize(uint32_t n) {
-      if (it) return (uint32_t) memo_it_put(it, (void *) n);
+    zdd_id_t memoize(zdd_id_t n) {
+      if (it) {
+	return (zdd_id_t) (uintptr_t) memo_it_put(it, (void *) (uintptr_t) n);
+      }
       return n;
     }
     // state == NULL is a special case that we use during the first call.
@@ -169,7 +173,7 @@ void compute_grid_graph(grid_graph_t gg) {
     } else {
       state[count] = 0;
       int just_created = memo_it_insert(&it, cache[e], state);
-      if (!just_created) return (uint32_t) memo_it_data(it);
+      if (!just_created) return (zdd_id_t) (uintptr_t) memo_it_data(it);
       // Examine part of state that cannot be affected by future choices,
       // including whether we include the current edge.
       // Return false node if it's impossible to continue, otherwise
@@ -211,11 +215,11 @@ void compute_grid_graph(grid_graph_t gg) {
     }
 
     // Recurse the case where we don't pick the current edge.
-    uint32_t lo = recurse(e + 1, newstate, au[e], newcount);
+    zdd_id_t lo = recurse(e + 1, newstate, au[e], newcount);
 
     // Before we recurse the other case, we must check a couple of things.
     // Let's initially assume we are done if we pick the current edge!
-    uint32_t hi = 1;
+    zdd_id_t hi = 1;
     // Examine the other ends of au[e] and av[e], conveniently located at
     // the ends of newstate[].
     int u = newstate[0];
@@ -248,7 +252,9 @@ void compute_grid_graph(grid_graph_t gg) {
   zdd_push();
   zdd_set_root(recurse(1, NULL, 0, 0));
   for(int i = 0; i <= zdd_vmax(); i++) memo_clear(cache[i]);
-  for(uint16_t v = 1; v <= zdd_vmax(); v++) memo_clear(node_tab[v]);
+  for(uint32_t v = 1; v <= zdd_vmax(); v++) memo_clear(node_tab[v]);
+  free(cache);
+  free(node_tab);
 }
 
 int main() {
@@ -347,6 +353,8 @@ int main() {
   }
 
   zdd_init();
+  // Cycles are built by hand, with variables for levels.
+  zdd_set_reorder(0);
   for(int n = 2; n <= 3; n++) {
     printf("All loops in %dx%d grid graph\n", n, n);
     grid_graph_init(gg, n);
@@ -9,6 +9,14 @@
 #include <stdarg.h>
 #include "io.h"
 
+// The edges at each cell of the board, row by row.
+static inta_t *cells;
+
+// Exactly one domino covers cell k.
+static void cell(int k) {
+  zdd_contains_exactly_1(inta_raw(cells[k]), inta_count(cells[k]));
+}
+
 int main() {
   zdd_init();
 
@@ -87,31 +95,14 @@ int main() {
   }
   zdd_set_vmax(v - 1);
 
-  int todo = rcount - 1;
-  for(int i = 0; i < rcount; i++) {
-    for(int j = 0; j < ccount; j++) {
-      zdd_contains_exactly_1(inta_raw(list[i][j]), inta_count(list[i][j]));
-      if (j) zdd_intersection();
-    }
-
-    int n = i + 1;
-    while (!(n & 1)) {
-      n >>= 1;
-      zdd_intersection();
-      todo--;
-    }
-  }
-  while(todo--) zdd_intersection();
+  cells = list[0];
+  zdd_intersect_tree(rcount * ccount, cell);
 
-  int compar(const void *a, const void *b) {
-    return inta_count((const inta_ptr) a) > inta_count((const inta_ptr) b);
-  }
-  qsort(tally, n, sizeof(inta_t), compar);
+  // The library picks the order: small, closely related constraints first.
   for(int i = 0; i < n; i++) {
-    //printf("%d/%d\n", i + 1, n);
     zdd_contains_exactly_1(inta_raw(tally[i]), inta_count(tally[i]));
-    zdd_intersection();
   }
+  zdd_intersect_all(n + 1);
 
   // Print lexicographically largest solution, assuming it exists.
   char pic[2 * rcount + 1][2 * ccount + 1];
@@ -124,10 +115,10 @@ int main() {
     }
     pic[2 * i][2 * ccount] = pic[2 * i + 1][2 * ccount] = '\0';
   }
-  v = zdd_root();
-  while(v != 1) {
-    int i = zdd_v(v) / (rcount + ccount);
-    int j = zdd_v(v) % (rcount + ccount);
+  zdd_id_t p = zdd_root();
+  while(p != 1) {
+    int i = zdd_var(zdd_v(p)) / (rcount + ccount);
+    int j = zdd_var(zdd_v(p)) % (rcount + ccount);
     if (!j) {
       pic[2 * i - 1][2 * (ccount - 1)] = ' ';
     } else if (rcount - 1 == i) {
@@ -139,7 +130,7 @@ int main() {
 	pic[2 * i + 1][j - 2] = ' ';
       }
     }
-    v = zdd_hi(v);
+    p = zdd_hi(p);
   }
   for(int i = 0; i < 2 * rcount; i++) {
     puts(pic[i]);
@@ -216,16 +216,17 @@ abort:
 
   // Othewise, each square can be covered by at most one of the polyominoes we
   // enumerated.
+  // A row at a time, in one pass with what we have so far.
   for (int i = 0; i < rcount; i++) {
-    int first = 1;
+    int count = 1;
     for (int j = 0; j < ccount; j++) {
       if (board[i][j] != 0) continue;
       if (inta_count(white[i][j]) > 1) {
 	zdd_contains_at_most_1(inta_raw(white[i][j]), inta_count(white[i][j]));
-	if (first) first = 0; else zdd_intersection();
+	count++;
       }
     }
-    zdd_intersection();
+    zdd_intersect_n(count);
   }
 
   // Adjacent polyominoes must differ in size.
@@ -51,10 +51,10 @@ int main() {
   // represents which square.
   zdd_contains_0(inta_raw(a), inta_count(a));
 
-  int colcount = 0;
+  // Push every constraint, then let the library pick the order in which to
+  // intersect them.
+  int count = 1;
   for (uint32_t i = 0; i < rcount; i++) {
-    inta_remove_all(a);
-    zdd_contains_at_most_1(inta_raw(a), inta_count(a));
     for (uint32_t j = 0; j < ccount; j++) {
       switch(board[i][j]) {
 	case -1:
@@ -78,6 +78,7 @@ int main() {
 	    inta_append(a, getv(k, j));
 	  }
 	  zdd_contains_at_least_1(inta_raw(a), inta_count(a));
+	  count++;
 	  // There is at most one light bulb in this row. We record this when
 	  // we first enter the row.
 	  if (r0 == i) {
@@ -86,7 +87,7 @@ int main() {
 	      inta_append(a, getv(k, j));
 	    }
 	    zdd_contains_at_most_1(inta_raw(a), inta_count(a));
-	    zdd_intersection();
+	    count++;
 	  }
 	  // Similarly for columns.
 	  if (c0 == j) {
@@ -95,10 +96,8 @@ int main() {
 	      inta_append(a, getv(i, k));
 	    }
 	    zdd_contains_at_most_1(inta_raw(a), inta_count(a));
-	    // Defer the intersection.
-	    colcount++;
+	    count++;
 	  }
-	  zdd_intersection();
 	  break;
 	case 0 ... 4:
 	  inta_remove_all(a);
@@ -113,16 +112,11 @@ int main() {
 	  check(i, j + 1);
 	  check(i + 1, j);
           zdd_contains_exactly_n(board[i][j], inta_raw(a), inta_count(a));
-	  zdd_intersection();
+	  count++;
       }
     }
-    zdd_intersection();
-  }
-
-  while(colcount) {
-    zdd_intersection();
-    colcount--;
   }
+  zdd_intersect_all(count);
 
   void printsol(int *v, int vcount) {
     char pic[rcount][ccount];
@@ -10,6 +10,10 @@
 
 int main() {
   zdd_init();
+  // The clue ZDD is walked one edge at a time, with raw edges.
+  zdd_set_chains(0);
+  zdd_set_complement(0);
+  zdd_set_reorder(0);
 
   int max;
   if (!scanf("%d\n", &max)) die("input error");
@@ -65,7 +69,8 @@ int main() {
 
   zdd_set_vmax(max * (max - 1) * 2);
   // Arcs go from u to v.
-  int au[zdd_vmax() + 1], av[zdd_vmax() + 1];
+  int *au = malloc(sizeof(*au) * (zdd_vmax() + 1));
+  int *av = malloc(sizeof(*av) * (zdd_vmax() + 1));
   i = 1;
   for(v = 1; v <= max * max; v++) {
     if (ctab[v] != max - 1) {
@@ -81,72 +86,66 @@ int main() {
   }
 
   // Add in clues.
-  int done = 0, todo = -1;
+  int *clue = malloc(sizeof(*clue) * (max - 1) * (max - 1)), nclue = 0;
   for(int i = 0; i < max - 1; i++) for(int j = 0; j < max - 1; j++) {
-    int n = board[i][j];
-    if (n != -1) {
-      int a[4];
-      int e = 1;
-      // Top left corner should have two outedges: one right, one down.
-      while(au[e] != vtab[i][j]) e++;
-      a[0] = e;
-      a[1] = e + 1;
-      EXPECT(au[e + 1] == vtab[i][j]);
-      // One more from the top right corner going down.
-      while(au[e] != vtab[i][j + 1]) e++;
-      if (av[e] != vtab[i + 1][j + 1]) e++;
-      a[2] = e;
-      // One more from the bottom left corner going right.
-      while(au[e] != vtab[i + 1][j]) e++;
-      a[3] = e;
-      zdd_contains_exactly_n(n, a, 4);
-
-      todo++;
-      int n = todo + 1;
-      while (!(n & 1)) {
-	n >>= 1;
-	zdd_intersection();
-	done++;
-      }
-    }
+    if (board[i][j] != -1) clue[nclue++] = i * (max - 1) + j;
   }
-  while (done < todo) {
-    zdd_intersection();
-    done++;
+  void add_clue(int k) {
+    int i = clue[k] / (max - 1), j = clue[k] % (max - 1);
+    int a[4];
+    int e = 1;
+    // Top left corner should have two outedges: one right, one down.
+    while(au[e] != vtab[i][j]) e++;
+    a[0] = e;
+    a[1] = e + 1;
+    EXPECT(au[e + 1] == vtab[i][j]);
+    // One more from the top right corner going down.
+    while(au[e] != vtab[i][j + 1]) e++;
+    if (av[e] != vtab[i + 1][j + 1]) e++;
+    a[2] = e;
+    // One more from the bottom left corner going right.
+    while(au[e] != vtab[i + 1][j]) e++;
+    a[3] = e;
+    zdd_contains_exactly_n(board[i][j], a, 4);
   }
+  zdd_intersect_tree(nclue, add_clue);
+  free(clue);
 
-  uint32_t p = zdd_root();
-  uint32_t clue_size = zdd_last_node();
+  zdd_id_t p = zdd_root();
+  zdd_id_t clue_size = zdd_last_node();
   // Construct ZDD of all simple loops constrained by the clues.
-  memo_t node_tab[zdd_vmax() + 1];
-  for(uint16_t v = 1; v <= zdd_vmax(); v++) memo_init(node_tab[v]);
+  memo_t *node_tab = malloc(sizeof(*node_tab) * (zdd_vmax() + 1));
+  for(uint32_t v = 1; v <= zdd_vmax(); v++) memo_init(node_tab[v]);
 
-  uint32_t unique(uint16_t v, uint32_t lo, uint32_t hi) {
+  zdd_id_t unique(uint32_t v, zdd_id_t lo, zdd_id_t hi) {
     // Create or return existing node representing !v ? lo : hi.
-    uint32_t key[2] = { lo, hi };
+    zdd_id_t key[2] = { lo, hi };
     memo_it it;
-    int just_created = memo_it_insert_u(&it, node_tab[v], (void *) key, 8);
+    int just_created = memo_it_insert_u(&it, node_tab[v], (void *) key,
+					 sizeof(key));
     if (just_created) {
-      uint32_t r;
-      memo_it_put(it, (void *) (r = zdd_abs_node(v, lo, hi)));
-      if (!(r << 15)) printf("node #%x\n", r);
+      zdd_id_t r;
+      memo_it_put(it, (void *) (uintptr_t) (r = zdd_abs_node(v, lo, hi)));
+      if (!(r & 0x1ffff)) printf("node #%lx\n", (unsigned long) r);
       return r;
     }
-    return (uint32_t) memo_it_data(it);
+    return (zdd_id_t) (uintptr_t) memo_it_data(it);
   }
 
   // Similar to the routine in cycle_test.c, but at the same time we respect
   // the clues. The node p in the clue ZDD therefore is part of the state.
-  memo_t cache[clue_size + 1];
+  memo_t *cache = malloc(sizeof(*cache) * (clue_size + 1));
   for(int i = 0; i <= clue_size; i++) memo_init(cache[i]);
-  uint32_t recurse(uint32_t p, char *state, int start, int count) {
+  zdd_id_t recurse(zdd_id_t p, char *state, int start, int count) {
     if (p <= 1) return p;
     int e = zdd_v(p);
     char newstate[max + 1];
     int newcount = 0;
     memo_it it = NULL;
-    uint32_t memoize(uint32_t n) {
-      if (it) return (uint32_t) memo_it_put(it, (void *) n);
+    zdd_id_t memoize(zdd_id_t n) {
+      if (it) {
+	return (zdd_id_t) (uintptr_t) memo_it_put(it, (void *) (uintptr_t) n);
+      }
       return n;
     }
     // state == NULL is a special case that we use during the first call.
@@ -168,7 +167,9 @@ int main() {
       }
       state[count + ++hacki] = 0;
       int just_created = memo_it_insert(&it, cache[p], state);
-      if (!just_created && p <= 29) return (uint32_t) memo_it_data(it);
+      if (!just_created && p <= 29) {
+	return (zdd_id_t) (uintptr_t) memo_it_data(it);
+      }
       // Examine part of state that cannot be affected by future choices,
       // including whether we include the current edge.
       // Return false node if it's impossible to continue, otherwise
@@ -225,12 +226,12 @@ int main() {
     // complete a loop (since we have not completed a loop yet). Similarly
     // we must use the current edge, we cannot complete a loop. Otherwise
     // recurse.
-    uint32_t lo = 1 >= zdd_lo(p) ? 0 :
+    zdd_id_t lo = 1 >= zdd_lo(p) ? 0 :
         recurse(zdd_lo(p), newstate, au[e], newcount);
 
     // Before we recurse the other case, we must check a couple of things.
     // Let's initially assume we are done if we pick the current edge!
-    uint32_t hi = 1;
+    zdd_id_t hi = 1;
     // Examine the other ends of au[e] and av[e], conveniently located at
     // the ends of newstate[].
     int u = newstate[0];
@@ -249,7 +250,7 @@ int main() {
       }
       // ...and the clues allow us to pick no higher edges.
       if (1 == hi) {
-	uint32_t q = zdd_hi(p);
+	zdd_id_t q = zdd_hi(p);
 	while(q > 1) q = zdd_lo(q);
 	hi = q;
       }
@@ -272,7 +273,9 @@ int main() {
   zdd_push();
   zdd_set_root(recurse(p, NULL, 0, 0));
   for(int i = 0; i <= clue_size; i++) memo_clear(cache[i]);
-  for(uint16_t v = 1; v <= zdd_vmax(); v++) memo_clear(node_tab[v]);
+  for(uint32_t v = 1; v <= zdd_vmax(); v++) memo_clear(node_tab[v]);
+  free(cache);
+  free(node_tab);
   zdd_intersection();
 
   void printsol(int *v, int vcount) {
@@ -368,4 +371,6 @@ int main() {
     putchar('\n');
   }
   zdd_forall(printsol);
+  free(au);
+  free(av);
 }
@@ -12,14 +12,14 @@ static int max;
 // Build ZDD for given row clues, and the root of the ZDD for all later rows.
 // Call this from the bottom row to the top row to produce the ZDD of all
 // sets satisfying the row clues.
-uint32_t add_row_clue(int row, int *a, int size, int root) {
+zdd_id_t add_row_clue(int row, int *a, int size, zdd_id_t root) {
   uint32_t v = row * max + 1;
-  uint32_t table[max][max + 1];
-  uint32_t partial_row(uint32_t i, int *a, int count, int sum) {
+  zdd_id_t table[max][max + 1];
+  zdd_id_t partial_row(uint32_t i, int *a, int count, int sum) {
     // Return old result if already computed.
     if (table[i][count] != 0) return table[i][count];
     // Handle the case when the first coloured segment appears immediately.
-    uint32_t first, last;
+    zdd_id_t first, last;
     first = last = table[i][count] = zdd_add_node(v + i, 0, 1);
     for(int j = 1; j < *a; j++) {
       last = zdd_add_node(v + i + j, 0, 1);
@@ -39,7 +39,7 @@ uint32_t add_row_clue(int row, int *a, int size, int root) {
     return table[i][count];
   }
 
-  memset(table, 0, sizeof(uint32_t) * max * (max + 1));
+  memset(table, 0, sizeof(zdd_id_t) * max * (max + 1));
   int sum = 0;
   for (int i = 0; i < size; i++) {
     sum += a[i];
@@ -47,12 +47,12 @@ uint32_t add_row_clue(int row, int *a, int size, int root) {
   return partial_row(0, a, size, sum);
 }
 
-uint32_t compute_col_clue(int col, int *a, int size) {
-  uint32_t table[max + 1][max + 1];
-  memset(table, 0, sizeof(uint32_t) * (max + 1) * (max + 1));
+zdd_id_t compute_col_clue(int col, int *a, int size) {
+  zdd_id_t table[max + 1][max + 1];
+  memset(table, 0, sizeof(zdd_id_t) * (max + 1) * (max + 1));
   // Variables outside this column can be in our out, so until we reach
   // the last node we send both edges to the next node.
-  uint32_t tail(uint32_t v, uint32_t i) {
+  zdd_id_t tail(uint32_t v, uint32_t i) {
     if (table[i][0] != 0) return table[i][0];
     table[i][0] = zdd_next_node();
     if (max == i) {
@@ -64,14 +64,14 @@ uint32_t compute_col_clue(int col, int *a, int size) {
       // coloured segment in this column.
       while(v < max * i + col + 1) zdd_add_node(v++, 1, 1);
       v++;
-      uint32_t last = zdd_last_node();
+      zdd_id_t last = zdd_last_node();
       zdd_set_hilo(last, tail(v, i + 1));
     }
     return table[i][0];
   }
-  uint32_t partial_col(uint32_t v, uint32_t i, int *a, int count, int sum) {
+  zdd_id_t partial_col(uint32_t v, uint32_t i, int *a, int count, int sum) {
     if (table[i][count] != 0) return table[i][count];
-    uint32_t first, last;
+    zdd_id_t first, last;
     table[i][count] = zdd_next_node();
     // Variables outside this column can be in our out.
     while(v < col + 1 + i * max) zdd_add_node(v++, 1, 1);
@@ -105,7 +105,10 @@ uint32_t compute_col_clue(int col, int *a, int size) {
 
 int main() {
   zdd_init();
+  // Rows are built by hand, with variables for levels.
+  zdd_set_reorder(0);
   if (!scanf("%d\n", &max)) die("input error");
+  zdd_set_vmax(max * max);
   // Read max row clues, then max column clues.
   int clue[max * 2][max + 1];
   for(int i = 0; i < max * 2; i++) {
@@ -129,7 +132,7 @@ int main() {
 
   // Construct ZDD for all row clues.
   zdd_push();
-  uint32_t root = 1;
+  zdd_id_t root = 1;
   for(int i = max - 1; i >= 0; i--) {
     if (clue[i][0]) {
       root = add_row_clue(i, &clue[i][1], clue[i][0], root);
@@ -138,21 +141,19 @@ int main() {
   zdd_set_root(root);
 
   //printf("all rows: %d\n", zdd_next_node());
-  // Intersect each column clue into the ZDD
+  // Intersect the column clues with the ZDD, all in one pass.
   for(int i = 0; i < max; i++) {
     zdd_push();
     compute_col_clue(i, &clue[i + max][1], clue[i + max][0]);
-    //printf("column %d: %d\n", i, zdd_next_node());
-    zdd_intersection();
-    //printf("intersected: %d\n", zdd_next_node());
   }
+  zdd_intersect_n(max + 1);
 
   zdd_check();
 
   // Print lexicographically largest solution, assuming it exists.
   int board[max][max];
   memset(board, 0, sizeof(int) * max * max);
-  uint32_t v = zdd_root();
+  zdd_id_t v = zdd_root();
   while(v != 1) {
     int r = zdd_v(v) - 1;
     int c = r % max;
@@ -7,51 +7,17 @@
 #include <stdarg.h>
 #include "io.h"
 
-// Construct ZDD of sets containing exactly 1 digit at forall boxes
-// (r, c), starting at pool entry d.
-//
-// The ZDD begins:
-//   1 ... 2
-//   1 --- 10
-//   2 ... 3
-//   2 --- 10
-//   ...
-//   9 ... F
-//   9 --- 10
-//
-// and repeats every 10 levels:
-//   10 ... 11
-//   10 --- 19
-// and so on until 729 --- F, 729 ... T.
+// Construct ZDD of sets containing exactly 1 digit at forall boxes: the
+// digits of a box are an interval of 9 elements.
 //
 // This ZDD has 9^81 members.
 void global_one_digit_per_box() {
-  zdd_push();
-  int next = 9;
-  uint32_t n = zdd_next_node();
-  for(int i = 1; i <= 729; i++) {
-    zdd_add_node(i, (i % 9) ? 1 : 0, -1);
-    if (next < 729) {
-      zdd_set_hi(zdd_last_node(), n + next);
-    }
-    if (!(i % 9)) next += 9;
-  }
+  int list[81];
+  for(int i = 0; i < 81; i++) list[i] = 9 * i + 1;
+  zdd_1_per_interval(list, 81);
 }
 
 // Construct ZDD of sets containing exactly 1 occurrence of digit d in row r.
-// For instance, if d = 3, r = 0:
-//
-//   1 === 2 === 3
-//   3 ... 4a, --- 4b
-//   4a === 5a === ... === 9a === ... === 11a === 12
-//   4b === 5b === ... === 9b === ... === 11b === 13b
-//   12 ... 13a, --- 13b
-//   13a === ... === 20a === 21
-//   13b === ... === 20b === 22b
-// and so on until:
-//   74a === 75 ... F, --- 76
-//   74b === 76
-//   76 === ... === 729 === T
 //
 // This ZDD has 9*2^720 members.
 // When intersected with the one-digit-per-box set, the result has
@@ -61,65 +27,24 @@ void global_one_digit_per_box() {
 // The intersection forall d and a fixed r has 9!*9^72 members.
 // The intersection forall r and a fixed d has 9^9*8^72 members.
 void unique_digit_per_row(int d, int r) {
-  zdd_push();
-  // The order is determined by sorting by number, then by letter.
-  int next = 81 * r + d;  // The next node involving the digit d.
-  int v = 1;
-  int state = 0;
-  while (v <= 729) {
-    if (v == next) {
-      next += 9;
-      state++;
-      if (state == 1) {
-	// The first split in the ZDD.
-	zdd_add_node(v, 1, 2);
-      } else if (state < 9) {
-	// Fix previous node. We must not have a second occurrence of d.
-	uint32_t n = zdd_last_node();
-	zdd_set_hilo(n, n + 3);
-	// If this is the first occurrence of d, we're on notice.
-	zdd_add_node(v, 1, 2);
-      } else {
-	// If we never saw d, then branch to FALSE.
-	// Otherwise reunite the branches.
-	zdd_add_node(v, 0, 1);
-	next = -1;
-      }
-    } else if (state == 0 || state == 9) {
-      zdd_add_node(v, 1, 1);
-    } else {
-      zdd_add_node(v, 2, 2);
-      zdd_add_node(v, 2, 2);
-    }
-    v++;
+  int list[9];
+  for(int i = 0; i < 9; i++) {
+    list[i] = 81 * r + 9 * i + d;
   }
-  // Fix last nodes.
-  uint32_t n = zdd_last_node();
-  if (zdd_lo(n - 1) > n) zdd_set_lo(n - 1, 1);
-  if (zdd_hi(n - 1) > n) zdd_set_hi(n - 1, 1);
-  if (zdd_lo(n) > n) zdd_set_lo(n, 1);
-  if (zdd_hi(n) > n) zdd_set_hi(n, 1);
+  zdd_contains_exactly_1(list, 9);
 }
 
 // Construct ZDD of sets containing all elements in the given list.
 // The list is terminated by -1.
 void contains_all(int *list) {
-  zdd_push();
-  int v = 1;
-  int *next = list;
-  while (v <= 729) {
-    if (v == *next) {
-      next++;
-      zdd_add_node(v, 0, 1);
-    } else {
-      zdd_add_node(v, 1, 1);
-    }
-    v++;
+  if (-1 == *list) {
+    zdd_powerset();
+    return;
+  }
+  for(int *p = list; -1 != *p; p++) {
+    zdd_contains_at_least_1(p, 1);
+    if (p != list) zdd_intersection();
   }
-  // Fix 729.
-  uint32_t n = zdd_last_node();
-  if (zdd_lo(n) > n) zdd_set_lo(n, 1);
-  if (zdd_hi(n) > n) zdd_set_hi(n, 1);
 }
 
 void unique_digit_per_col(int d, int col) {
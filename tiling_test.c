@@ -2,12 +2,44 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include "inta.h"
 #include "zdd.h"
 #include "io.h"
 
 inta_t board[8][8];
 
+// Wall time, so runs on several threads are comparable.
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Whether the family on top of the stack has n sets.
+static int count_is(unsigned long n) {
+  mpz_t z;
+  mpz_init(z);
+  zdd_count(z);
+  int r = !mpz_cmp_ui(z, n);
+  mpz_clear(z);
+  return r;
+}
+
+// Runs a test once for each node format: with chains, without, and with
+// complement edges. Leaves chains on.
+static void each_format(void (*test)()) {
+  for (int format = 0; format < 3; format++) {
+    zdd_set_chains(format != 1);
+    if (2 == format) zdd_set_complement(1);
+    test();
+  }
+  zdd_set_chains(1);
+}
+
+// Sets seen so far by the zdd_forall() callbacks below.
+static int seen;
+
 // How many ways can you tile a chessboard with monominoes?
 // This trivial case serves as a sanity check.
 void test_monomino_tilings() {
@@ -30,7 +62,7 @@ void test_monomino_tilings() {
     }
   }
 
-  printf("nodes: %d\n", zdd_size());
+  printf("nodes: %lu\n", (unsigned long) zdd_size());
   EXPECT(zdd_size() == 8 * 8 + 2);
   mpz_t z, answer;
   mpz_init(z);
@@ -80,7 +112,7 @@ void test_domino_tilings() {
     }
   }
 
-  printf("nodes: %d\n", zdd_size());
+  printf("nodes: %lu\n", (unsigned long) zdd_size());
   EXPECT(zdd_size() == 2300);
   mpz_t z, answer;
   mpz_init(z);
@@ -91,6 +123,33 @@ void test_domino_tilings() {
   gmp_printf("2-omino tilings: %Zd\n", z);
   EXPECT(!mpz_cmp(z, answer));
 
+  // Keep the tilings, and reuse them to count those with a given domino in
+  // the corner. By symmetry, either domino covers it in half the tilings.
+  int h = zdd_keep();
+  zdd_pop();
+  for (int d = 1; d <= 2; d++) {
+    zdd_load(h);
+    zdd_contains_exactly_1(&d, 1);
+    zdd_intersection();
+    zdd_count(z);
+    gmp_printf("with domino %d: %Zd\n", d, z);
+    EXPECT(!mpz_cmp_ui(z, 12988816 / 2));
+    zdd_pop();
+  }
+  // Projected onto those two dominoes, the tilings leave just {1} and {2}.
+  int corner[2] = { 1, 2 };
+  zdd_load(h);
+  zdd_project(corner, 2);
+  zdd_count(z);
+  EXPECT(!mpz_cmp_ui(z, 2));
+  zdd_pop();
+  zdd_gc();
+  zdd_load(h);
+  zdd_count(z);
+  EXPECT(!mpz_cmp(z, answer));
+  EXPECT(zdd_size() == 2300);
+  zdd_release(h);
+
   mpz_clear(z);
   mpz_clear(answer);
   zdd_pop();
@@ -100,9 +159,537 @@ void test_domino_tilings() {
   }
 }
 
+static void check_even_singleton(int *v, int count) {
+  EXPECT(1 == count && !(v[0] & 1));
+  seen++;
+}
+
+// Variables are not limited to 16 bits. Choose one of 100000 elements, then
+// rule out the odd ones. The ZDDs are as deep as there are variables, so
+// this also checks that nothing recurses once per level.
+void test_many_variables() {
+  enum { N = 100000 };
+  int *a = malloc(sizeof(*a) * N);
+  int *odd = malloc(sizeof(*odd) * N), *even = malloc(sizeof(*even) * N);
+  for (int i = 0; i < N; i++) a[i] = i + 1;
+  int nodd = 0, neven = 0;
+  for (int i = 0; i < N; i += 2) {
+    odd[nodd++] = i + 1;
+    even[neven++] = i + 2;
+  }
+  zdd_set_vmax(N);
+  EXPECT(N == zdd_vmax());
+  mpz_t z;
+  mpz_init(z);
+  zdd_contains_exactly_1(a, N);
+  zdd_contains_0(odd, nodd);
+  zdd_intersection();
+  zdd_count(z);
+  gmp_printf("even singletons: %Zd\n", z);
+  EXPECT(!mpz_cmp_ui(z, N / 2));
+  seen = 0;
+  zdd_forall(check_even_singleton);
+  EXPECT(N / 2 == seen);
+  int he = zdd_keep();
+  zdd_pop();
+  // Unions and differences of families as deep as the variables go.
+  zdd_load(he);
+  zdd_contains_exactly_1(a, N);
+  zdd_contains_0(even, neven);
+  zdd_intersection();
+  zdd_union();
+  EXPECT(count_is(N));
+  zdd_load(he);
+  zdd_difference();
+  EXPECT(count_is(N / 2));
+  zdd_load(he);
+  zdd_symdiff();
+  EXPECT(count_is(N));
+  zdd_pop();
+  // Every even singleton joined to every odd one.
+  zdd_load(he);
+  zdd_contains_exactly_1(a, N);
+  zdd_contains_0(even, neven);
+  zdd_intersection();
+  zdd_join();
+  EXPECT(count_is((unsigned long) (N / 2) * (N / 2)));
+  zdd_pop();
+  // Of the sets with at most one element, the singletons are maximal and
+  // the empty set minimal.
+  zdd_contains_at_most_1(a, N);
+  zdd_maximal();
+  EXPECT(count_is(N));
+  zdd_pop();
+  zdd_contains_at_most_1(a, N);
+  zdd_minimal();
+  EXPECT(count_is(1));
+  zdd_pop();
+  // Restrict by the last variable, below every other level.
+  zdd_contains_at_most_1(a, N);
+  int h1 = zdd_keep();
+  zdd_onset(N);
+  EXPECT(count_is(1));
+  zdd_pop();
+  zdd_load(h1);
+  zdd_offset(N);
+  EXPECT(count_is(N));
+  zdd_change(N);
+  EXPECT(count_is(N));
+  zdd_pop();
+  int lit[2] = { N, -1 };
+  zdd_load(h1);
+  zdd_assign(lit, 1);
+  EXPECT(count_is(1));
+  zdd_pop();
+  zdd_load(h1);
+  zdd_assign(lit + 1, 1);
+  EXPECT(count_is(N));
+  zdd_pop();
+  // Projected onto the last variable, or onto the odd ones.
+  zdd_load(h1);
+  zdd_project(lit, 1);
+  EXPECT(count_is(2));
+  zdd_pop();
+  zdd_load(h1);
+  zdd_project(odd, nodd);
+  EXPECT(count_is(N / 2 + 1));
+  zdd_pop();
+  zdd_release(h1);
+  // An n-ary traversal as deep as the variables go.
+  zdd_contains_exactly_1(a, N);
+  zdd_contains_at_most_1(a, N);
+  zdd_contains_at_least_1(a, N);
+  zdd_intersect_n(3);
+  EXPECT(count_is(N));
+  zdd_pop();
+  // On two threads, a meld that branches at every level fills a worker's
+  // deque long before the bottom.
+  int threads = zdd_threads();
+  zdd_set_threads(2);
+  zdd_contains_exactly_1(a, N);
+  zdd_contains_at_most_1(a, N);
+  zdd_intersection();
+  EXPECT(count_is(N));
+  zdd_pop();
+  zdd_set_threads(threads);
+  zdd_release(he);
+  mpz_clear(z);
+  free(a);
+  free(odd);
+  free(even);
+}
+
+static void check_has_2(int *v, int count) {
+  int has2 = 0;
+  for (int i = 0; i < count; i++) has2 += 2 == v[i];
+  EXPECT(1 == has2);
+  seen++;
+}
+
+// Runs of don't-care variables take one node each, and counting and
+// enumeration account for them.
+void test_chains() {
+  enum { N = 1000 };
+  zdd_set_vmax(N);
+  zdd_powerset();
+  printf("powerset nodes: %lu\n", (unsigned long) zdd_size());
+  EXPECT(zdd_size() == 3);
+  mpz_t z0, z1, z2, want;
+  mpz_init(z0);
+  mpz_init(z1);
+  mpz_init(z2);
+  mpz_init(want);
+  zdd_count_2(z0, z1, z2);
+  // 2^N sets, sizes summing to N 2^(N-1), squares to N(N+1) 2^(N-2).
+  mpz_ui_pow_ui(want, 2, N);
+  EXPECT(!mpz_cmp(z0, want));
+  mpz_mul_ui(want, want, N);
+  mpz_fdiv_q_2exp(want, want, 1);
+  EXPECT(!mpz_cmp(z1, want));
+  mpz_mul_ui(want, want, N + 1);
+  mpz_fdiv_q_2exp(want, want, 1);
+  EXPECT(!mpz_cmp(z2, want));
+  int a[2] = { 500, 700 };
+  zdd_contains_exactly_1(a, 2);
+  EXPECT(zdd_size() == 6);
+  zdd_id_t r = zdd_root();
+  zdd_intersection();
+  EXPECT(zdd_root() == r);
+  zdd_count_1(z0, z1);
+  // 2^(N-2) choices of the others, once with each of a[0] and a[1].
+  mpz_ui_pow_ui(want, 2, N - 2);
+  mpz_mul_ui(want, want, 2);
+  EXPECT(!mpz_cmp(z0, want));
+  mpz_ui_pow_ui(want, 2, N - 3);
+  mpz_mul_ui(want, want, 2 * (N - 2));
+  mpz_addmul_ui(want, z0, 1);
+  EXPECT(!mpz_cmp(z1, want));
+  zdd_pop();
+  mpz_clear(z0);
+  mpz_clear(z1);
+  mpz_clear(z2);
+  mpz_clear(want);
+
+  zdd_set_vmax(4);
+  int b[1] = { 2 };
+  zdd_contains_exactly_1(b, 1);
+  seen = 0;
+  zdd_forall(check_has_2);
+  EXPECT(8 == seen);
+  zdd_pop();
+}
+
+static void check_1_or_3(int *v, int count) {
+  // The empty set comes first.
+  EXPECT(seen || !count);
+  EXPECT(count < 2 || (1 == v[0] && 3 == v[1]));
+  seen++;
+}
+
+// With complement edges, a family with and without the empty set share all
+// their nodes, and intersections keep the empty set only when both sides
+// have it.
+void test_complement() {
+  zdd_set_complement(1);
+  zdd_set_vmax(3);
+  int a[3] = { 1, 2, 3 };
+  zdd_contains_exactly_1(a, 3);
+  zdd_id_t r = zdd_root();
+  zdd_id_t size = zdd_size();
+  zdd_contains_at_most_1(a, 3);
+  printf("at most 1 nodes: %lu\n", (unsigned long) zdd_size());
+  EXPECT(zdd_root() != r);
+  EXPECT(zdd_size() == size);
+  mpz_t z;
+  mpz_init(z);
+  zdd_count(z);
+  EXPECT(!mpz_cmp_ui(z, 4));
+  zdd_intersection();
+  EXPECT(zdd_root() == r);
+  zdd_pop();
+
+  for (int e = ZDD_DFS; e <= ZDD_BFS; e++) {
+    zdd_set_engine(e);
+    // At most one of 1, 2 and at most one of 2, 3.
+    zdd_contains_at_most_1(a, 2);
+    zdd_contains_at_most_1(a + 1, 2);
+    zdd_intersection();
+    zdd_count(z);
+    EXPECT(!mpz_cmp_ui(z, 5));
+    seen = 0;
+    zdd_forall(check_1_or_3);
+    EXPECT(5 == seen);
+    zdd_pop();
+  }
+  zdd_set_engine(ZDD_DFS);
+  mpz_clear(z);
+
+  test_domino_tilings();
+  zdd_set_chains(1);
+}
+
+enum { PAIRS = 8 };
+
+static void check_one_of_each_pair(int *v, int count) {
+  EXPECT(PAIRS == count);
+  for (int i = 0; i < count; i++) {
+    EXPECT(i < PAIRS - 1 ? v[i] < v[i + 1] : 1);
+    for (int j = 0; j < count; j++) EXPECT(v[j] != v[i] + PAIRS);
+  }
+  seen++;
+}
+
+// Pairing each of 1..N with one of N+1..2N, exactly one of each pair, takes
+// exponentially many nodes in the natural order and linearly many once the
+// pairs are adjacent. Sifting should find such an order.
+void test_reorder() {
+  enum { N = PAIRS };
+  zdd_set_reorder(1 << 30);
+  zdd_set_vmax(2 * N);
+  for (int i = 1; i <= N; i++) {
+    int a[2] = { i, N + i };
+    zdd_contains_exactly_1(a, 2);
+    if (i > 1) zdd_intersection();
+  }
+  zdd_id_t before = zdd_size();
+  zdd_reorder();
+  printf("pairs nodes: %lu, after sifting: %lu\n",
+         (unsigned long) before, (unsigned long) zdd_size());
+  EXPECT(zdd_size() < before);
+  EXPECT(zdd_size() <= 3 * N + 2);
+  for (uint32_t v = 1; v <= 2 * N; v++) EXPECT(zdd_var(zdd_level(v)) == v);
+  mpz_t z;
+  mpz_init(z);
+  zdd_count(z);
+  EXPECT(!mpz_cmp_ui(z, 1 << N));
+  seen = 0;
+  zdd_forall(check_one_of_each_pair);
+  EXPECT(1 << N == seen);
+  // Builders translate variables to levels.
+  int one = 1;
+  zdd_contains_exactly_1(&one, 1);
+  zdd_intersection();
+  zdd_count(z);
+  EXPECT(!mpz_cmp_ui(z, 1 << (N - 1)));
+  // A swap keeps the family.
+  zdd_swap(1);
+  zdd_count(z);
+  EXPECT(!mpz_cmp_ui(z, 1 << (N - 1)));
+  mpz_clear(z);
+  zdd_pop();
+  zdd_set_chains(1);
+}
+
+// A hand-built ZDD with duplicate nodes and a HI -> FALSE node shrinks to
+// the canonical ZDD of the same family.
+void test_reduce() {
+  zdd_set_vmax(3);
+  zdd_push();
+  // Two copies of !3 ? TRUE : TRUE, and a 2-node whose HI edge is FALSE.
+  zdd_id_t r = zdd_abs_node(1, 0, 0);
+  zdd_id_t a = zdd_abs_node(3, 1, 1);
+  zdd_id_t b = zdd_abs_node(3, 1, 1);
+  zdd_id_t c = zdd_abs_node(2, b, 0);
+  zdd_set_lo(r, a);
+  zdd_set_hi(r, c);
+  zdd_set_root(r);
+  zdd_reduce();
+  // {}, {3}, {1}, {1, 3}: the 2-node goes, and 1 points to 3 twice.
+  printf("reduced nodes: %lu\n", (unsigned long) zdd_size());
+  EXPECT(zdd_size() == 4);
+  mpz_t z;
+  mpz_init(z);
+  zdd_count(z);
+  EXPECT(!mpz_cmp_ui(z, 4));
+  mpz_clear(z);
+  zdd_pop();
+}
+
+// A holds at least one of 1, 2 and B exactly one of 2, 3, out of 6
+// variables: |A| = 48, |B| = 32 and |A & B| = 24.
+void test_setops() {
+  zdd_set_vmax(6);
+  int a[3] = { 1, 2, 3 };
+  // The powerset comes back as its root in every format.
+  EXPECT(zdd_powerset() == zdd_root());
+  EXPECT(count_is(64));
+  zdd_pop();
+  zdd_contains_at_least_1(a, 2);
+  int ha = zdd_keep();
+  zdd_contains_exactly_1(a + 1, 2);
+  int hb = zdd_keep();
+  zdd_union();
+  EXPECT(count_is(56));
+  zdd_pop();
+  zdd_load(ha);
+  zdd_load(hb);
+  zdd_difference();
+  EXPECT(count_is(24));
+  zdd_pop();
+  zdd_load(hb);
+  zdd_load(ha);
+  zdd_difference();
+  EXPECT(count_is(8));
+  zdd_pop();
+  zdd_load(ha);
+  zdd_load(hb);
+  zdd_symdiff();
+  EXPECT(count_is(32));
+  zdd_pop();
+  // Canonical form makes (A - B) | (A & B) the very same ZDD as A.
+  zdd_load(ha);
+  zdd_load(hb);
+  zdd_difference();
+  zdd_load(ha);
+  zdd_load(hb);
+  zdd_intersection();
+  zdd_id_t r = zdd_union();
+  zdd_pop();
+  zdd_load(ha);
+  EXPECT(zdd_root() == r);
+  zdd_pop();
+  // Taking away a disjoint family changes nothing, and a family's symmetric
+  // difference with itself is empty.
+  zdd_load(ha);
+  zdd_contains_0(a, 3);
+  zdd_difference();
+  EXPECT(count_is(48));
+  zdd_load(ha);
+  zdd_symdiff();
+  EXPECT(count_is(0));
+  zdd_pop();
+  zdd_release(ha);
+  zdd_release(hb);
+}
+
+// F = {{1}, {2}} and G = {{2}, {3}} out of 4 variables. Their join is
+// {{1, 2}, {1, 3}, {2}, {2, 3}}, whose quotient by G is {{1}}, leaving
+// {{2}, {2, 3}} as the remainder.
+void test_algebra() {
+  zdd_set_vmax(4);
+  int a[4] = { 1, 2, 3, 4 };
+  zdd_contains_exactly_1(a, 2);
+  zdd_contains_0(a + 2, 2);
+  zdd_intersection();
+  int hf = zdd_keep();
+  zdd_contains_exactly_1(a + 1, 2);
+  int b[2] = { 1, 4 };
+  zdd_contains_0(b, 2);
+  zdd_intersection();
+  int hg = zdd_keep();
+  zdd_join();
+  EXPECT(count_is(4));
+  int hj = zdd_keep();
+  zdd_pop();
+  zdd_load(hf);
+  zdd_load(hg);
+  zdd_meet();
+  EXPECT(count_is(2));
+  zdd_pop();
+  zdd_load(hf);
+  zdd_load(hg);
+  zdd_delta();
+  EXPECT(count_is(4));
+  zdd_pop();
+  zdd_load(hj);
+  zdd_load(hg);
+  zdd_quotient();
+  EXPECT(count_is(1));
+  // The quotient times G is back inside the join.
+  zdd_load(hg);
+  zdd_join();
+  zdd_load(hj);
+  zdd_difference();
+  EXPECT(count_is(0));
+  zdd_pop();
+  zdd_load(hj);
+  zdd_load(hg);
+  zdd_remainder();
+  EXPECT(count_is(2));
+  zdd_pop();
+  // Dividing by {{}} changes nothing.
+  zdd_load(hf);
+  zdd_contains_0(a, 4);
+  zdd_id_t r = zdd_quotient();
+  zdd_pop();
+  zdd_load(hf);
+  EXPECT(zdd_root() == r);
+  zdd_pop();
+  zdd_release(hf);
+  zdd_release(hg);
+  zdd_release(hj);
+}
+
+// Containment among sets of 1, 2 and 3.
+void test_containment() {
+  zdd_set_vmax(3);
+  int a[3] = { 1, 2, 3 };
+  // At most one element: the singletons are maximal, the empty set minimal.
+  zdd_contains_at_most_1(a, 3);
+  zdd_maximal();
+  EXPECT(count_is(3));
+  zdd_pop();
+  zdd_contains_at_most_1(a, 3);
+  zdd_minimal();
+  EXPECT(count_is(1));
+  zdd_pop();
+  // At least one of 1, 2: {1} and {2} are minimal, {1, 2, 3} maximal.
+  zdd_contains_at_least_1(a, 2);
+  int h = zdd_keep();
+  zdd_minimal();
+  EXPECT(count_is(2));
+  zdd_pop();
+  zdd_load(h);
+  zdd_maximal();
+  EXPECT(count_is(1));
+  zdd_pop();
+  // Of those 6 sets, {1, 2} contains {1}, {2} and itself, and is contained
+  // in itself and {1, 2, 3}. Push G = {{1, 2}}.
+  void g() {
+    zdd_contains_at_least_1(a, 1);
+    zdd_contains_at_least_1(a + 1, 1);
+    zdd_intersection();
+    zdd_contains_0(a + 2, 1);
+    zdd_intersection();
+  }
+  zdd_load(h);
+  g();
+  zdd_subsets();
+  EXPECT(count_is(3));
+  zdd_pop();
+  zdd_load(h);
+  g();
+  zdd_nonsub();
+  EXPECT(count_is(3));
+  zdd_pop();
+  zdd_load(h);
+  g();
+  zdd_supersets();
+  EXPECT(count_is(2));
+  zdd_pop();
+  zdd_load(h);
+  g();
+  zdd_nonsup();
+  EXPECT(count_is(4));
+  zdd_pop();
+  zdd_release(h);
+}
+
+// Cofactors of the sets with at least one of 1, 2 and 3.
+void test_cofactors() {
+  zdd_set_vmax(3);
+  int a[3] = { 1, 2, 3 };
+  zdd_contains_at_least_1(a, 3);
+  int h = zdd_keep();
+  zdd_pop();
+  // {1}, {1, 2}, {1, 3}, {1, 2, 3} less 1 includes the empty set.
+  zdd_load(h);
+  zdd_onset(1);
+  EXPECT(count_is(4));
+  zdd_contains_0(a, 3);
+  zdd_intersection();
+  EXPECT(count_is(1));
+  zdd_pop();
+  zdd_load(h);
+  zdd_offset(1);
+  EXPECT(count_is(3));
+  zdd_pop();
+  // Toggling 1 twice changes nothing, and toggling it once loses {1}.
+  zdd_load(h);
+  zdd_change(1);
+  EXPECT(count_is(7));
+  zdd_id_t r = zdd_change(1);
+  zdd_pop();
+  zdd_load(h);
+  EXPECT(zdd_root() == r);
+  zdd_pop();
+  // {1} and {1, 3}; a variable cannot be both in and out.
+  int lit[3] = { -2, 1, 1 };
+  zdd_load(h);
+  zdd_assign(lit, 3);
+  EXPECT(count_is(2));
+  zdd_pop();
+  lit[2] = -1;
+  zdd_load(h);
+  zdd_assign(lit, 3);
+  EXPECT(count_is(0));
+  zdd_pop();
+  // Projected onto 2, the sets merge into {} and {2}; onto nothing, {}.
+  zdd_load(h);
+  zdd_project(a + 1, 1);
+  EXPECT(count_is(2));
+  zdd_project(a, 0);
+  EXPECT(count_is(1));
+  zdd_pop();
+  zdd_release(h);
+}
+
 // How many ways can you tile a chessboard with 1-, 2- and 3-polyonominoes?
 // We expect 468 variables, 512227 nodes and 92109458286284989468604 solutions.
-void test_123_tilings() {
+// Fold the constraints by hand, with a reduction tree, in the order the
+// scheduler picks, or a row at a time in one pass each.
+enum { BY_HAND, BY_TREE, BY_SCHEDULE, BY_ROW };
+void test_123_tilings(int how) {
   int v = 1;
   for (int i = 0; i < 8; i++) {
     for (int j = 0; j < 8; j++) {
@@ -166,7 +753,23 @@ void test_123_tilings() {
     printf("\n");
   }
   */
-  for (int i = 0; i < 8; i++) {
+  double t = now();
+  void cell(int k) {
+    inta_ptr a = board[k / 8][k % 8];
+    zdd_contains_exactly_1(inta_raw(a), inta_count(a));
+  }
+  if (how == BY_TREE) {
+    zdd_intersect_tree(8 * 8, cell);
+  } else if (how == BY_SCHEDULE) {
+    for (int k = 0; k < 8 * 8; k++) cell(k);
+    zdd_intersect_all(8 * 8);
+  } else if (how == BY_ROW) {
+    // A row at a time, into what the rows above allow.
+    for (int i = 0; i < 8; i++) {
+      for (int j = 0; j < 8; j++) cell(8 * i + j);
+      zdd_intersect_n(i ? 9 : 8);
+    }
+  } else for (int i = 0; i < 8; i++) {
     for (int j = 0; j < 8; j++) {
       zdd_contains_exactly_1(inta_raw(board[i][j]), inta_count(board[i][j]));
       if (j) zdd_intersection();
@@ -178,17 +781,30 @@ void test_123_tilings() {
     }
   }
 
-  printf("nodes: %d\n", zdd_size());
+  double secs = now() - t;
+  printf("nodes: %lu\n", (unsigned long) zdd_size());
+  printf("time: %.2fs, %.0f nodes/s\n", secs, zdd_size() / secs);
   EXPECT(zdd_size() == 512227);
   mpz_t z, answer;
   mpz_init(z);
   mpz_init(answer);
   mpz_set_str(answer, "92109458286284989468604", 0);
 
+  t = now();
   zdd_count(z);
+  printf("count time: %.3fs\n", now() - t);
   gmp_printf("1-, 2-, 3-omino tilings: %Zd\n", z);
   EXPECT(!mpz_cmp(z, answer));
 
+  // Collecting lays the nodes out in depth-first order, which must not
+  // change anything but the speed.
+  zdd_gc();
+  EXPECT(zdd_size() == 512227);
+  t = now();
+  zdd_count(z);
+  printf("count time after gc: %.3fs\n", now() - t);
+  EXPECT(!mpz_cmp(z, answer));
+
   mpz_clear(z);
   mpz_clear(answer);
   zdd_pop();
@@ -207,7 +823,29 @@ int main() {
 
   test_monomino_tilings();
   test_domino_tilings();
-  test_123_tilings();
+  test_many_variables();
+  test_reduce();
+  test_chains();
+  test_complement();
+  test_reorder();
+  each_format(test_setops);
+  each_format(test_algebra);
+  each_format(test_containment);
+  each_format(test_cofactors);
+  // Both intersection engines must agree.
+  printf("depth-first:\n");
+  zdd_set_engine(ZDD_DFS);
+  test_123_tilings(BY_HAND);
+  printf("breadth-first:\n");
+  zdd_set_engine(ZDD_BFS);
+  test_123_tilings(BY_HAND);
+  printf("reduction tree:\n");
+  zdd_set_engine(ZDD_DFS);
+  test_123_tilings(BY_TREE);
+  printf("scheduled:\n");
+  test_123_tilings(BY_SCHEDULE);
+  printf("a row at a time:\n");
+  test_123_tilings(BY_ROW);
 
   // Clear board.
   for (int i = 0; i < 8; i++) for (int j = 0; j < 8; j++) {
@@ -4,507 +4,3222 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <gmp.h>
 #include "memo.h"
 #include "darray.h"
 #include "zdd.h"
 #include "io.h"
 
-struct node_s {
-  uint16_t v;
-  uint32_t lo, hi;
+// Node n is !pool_v[n] ? pool_lo[n] : pool_hi[n]. Keeping the fields in
+// separate arrays means a pass only pulls in the fields it reads.
+//
+// Following Bryant's chain-reduced ZDDs, a node may also stand for a run of
+// don't-care variables: variables pool_t[n] to pool_v[n] - 1 may each be in
+// or out of a set, then pool_v[n] is tested as usual. A plain node has
+// pool_t[n] == pool_v[n]. Chains are maximal: a node whose LO and HI edges
+// agree never points to a node starting at the next variable, as the two
+// would be merged into one.
+//
+// Optionally, following Minato, an edge may carry a complement bit, CMP,
+// which toggles whether the empty set is in the family it leads to. A LO
+// edge never carries it and never leads to TRUE, so no node's family holds
+// the empty set, and a family that does is reached by a complemented edge
+// (or is TRUE itself). Families that differ only in the empty set then share
+// every node. Complement edges and chains do not mix: a chain whose LO edge
+// toggles the empty set has no equivalent node without it.
+//
+// The pool is reserved up front for pool_max nodes but only backed by memory
+// up to pool_cap, which grows on demand. Node ids stay below ID_LIMIT because
+// unique table entries need room for some hash bits, and the breadth-first
+// engine tags requests with bit ID_BITS - 1.
+#ifdef ZDD_64
+#define ID_BITS 40
+#else
+#define ID_BITS 32
+#endif
+#define ID_MASK ((zdd_id_t) (((uint64_t) 1 << ID_BITS) - 1))
+#define ID_LIMIT (((zdd_id_t) 1 << (ID_BITS - 1)) - 1)
+#define CMP ((zdd_id_t) 1 << (ID_BITS - 2))
+// Stands for no node.
+#define NIL ((zdd_id_t) -1)
+
+static uint32_t *pool_t, *pool_v;
+static zdd_id_t *pool_lo, *pool_hi;
+static zdd_id_t freenode, pool_cap, pool_max = ID_LIMIT;
+static pthread_mutex_t pool_mu = PTHREAD_MUTEX_INITIALIZER;
+// Roots of the ZDDs on the stack.
+static darray_t stack;
+// Set while the ZDD on top of the stack is being built by hand, in the pool
+// from rawbase onwards.
+static char raw;
+static zdd_id_t rawbase;
+// Handles: roots kept alive by reference counts rather than the stack. A
+// count of zero marks a free slot.
+static zdd_id_t *hroot;
+static int *hcount, hmax;
+// Collect garbage once freenode reaches this.
+static zdd_id_t gc_next = 1 << 20;
+static uint32_t vmax;
+static char vmax_is_set;
+// Whether runs of don't-care variables are merged into one node.
+static char chains = 1;
+// CMP if edges may be complemented, otherwise 0, so masking it off is free.
+static zdd_id_t cbit;
+// Nodes test levels; lvl_var[l] is the variable at level l, and var_lvl its
+// inverse. Both are the identity unless reordered is set.
+static uint32_t *lvl_var, *var_lvl;
+static char reordered;
+// Sift when the pool reaches reorder_next nodes, if reorder_min of them are
+// live. A reorder_min of 0 means never.
+static zdd_id_t reorder_min, reorder_next;
+// Counts reorderings, so anything that remembers levels can tell.
+static int reorder_count;
+// Whether zdd_intersect_all() explains itself on stderr.
+static char schedule_log;
+// Which algorithm zdd_intersection() uses.
+static int engine = ZDD_DFS;
+// Worker threads for zdd_intersection(); 1 means none.
+static int nthreads = 1;
+static struct worker_s *workers;
+static void stop_workers();
+
+// The pool grows in multiples of this many nodes, so each array grows by
+// whole huge pages.
+enum { POOL_CHUNK = 1 << 20 };
+
+static size_t pool_top() {
+  return ((size_t) pool_max + POOL_CHUNK) / POOL_CHUNK * POOL_CHUNK;
+}
+
+static void *reserve(size_t size) {
+  void *p = mmap(NULL, size, PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (MAP_FAILED == p) {
+    die("cannot reserve pool of %lu nodes", (unsigned long) pool_max);
+  }
+  return p;
+}
+
+static void pool_reserve() {
+  pool_t = reserve(pool_top() * sizeof(*pool_t));
+  pool_v = reserve(pool_top() * sizeof(*pool_v));
+  pool_lo = reserve(pool_top() * sizeof(*pool_lo));
+  pool_hi = reserve(pool_top() * sizeof(*pool_hi));
+  pool_cap = 0;
+}
+
+// Pages are committed as they are first touched.
+static void commit(void *p, size_t size, size_t from, size_t to) {
+  char *lo = (char *) p + from * size;
+  if (mprotect(lo, (to - from) * size, PROT_READ | PROT_WRITE)) {
+    die("cannot grow pool to %zu nodes", to);
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(lo, (to - from) * size, MADV_HUGEPAGE);
+#endif
+}
+
+// Back the pool with memory up to and including node n, at least doubling
+// what there is so nodes are added in large steps. Safe to call from
+// several threads.
+static void pool_grow(zdd_id_t n) {
+  if (n > pool_max) die("pool is full");
+  pthread_mutex_lock(&pool_mu);
+  size_t cap = __atomic_load_n(&pool_cap, __ATOMIC_RELAXED);
+  if (n >= cap) {
+    size_t to = n + 1 > 2 * cap ? n + 1 : 2 * cap;
+    to = (to + POOL_CHUNK - 1) / POOL_CHUNK * POOL_CHUNK;
+    if (to > pool_top()) to = pool_top();
+    commit(pool_t, sizeof(*pool_t), cap, to);
+    commit(pool_v, sizeof(*pool_v), cap, to);
+    commit(pool_lo, sizeof(*pool_lo), cap, to);
+    commit(pool_hi, sizeof(*pool_hi), cap, to);
+    __atomic_store_n(&pool_cap, to > pool_max ? pool_max + 1 : to,
+        __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&pool_mu);
+}
+
+static inline void set_node(zdd_id_t n, uint32_t t, uint32_t v,
+                            zdd_id_t lo, zdd_id_t hi) {
+  pool_t[n] = t;
+  pool_v[n] = v;
+  pool_lo[n] = lo;
+  pool_hi[n] = hi;
+}
+
+// Make sure node n can be written.
+static inline void pool_need(zdd_id_t n) {
+  if (n >= __atomic_load_n(&pool_cap, __ATOMIC_ACQUIRE)) pool_grow(n);
+}
+
+// The node an edge leads to.
+static inline zdd_id_t idx(zdd_id_t e) {
+  return e & ~cbit;
+}
+
+// Whether the family an edge leads to holds the empty set.
+static inline int has_empty(zdd_id_t e) {
+  return 1 == e || (e & cbit);
+}
+
+// The edge to the same family with the empty set toggled. Only meaningful
+// with complement edges.
+static inline zdd_id_t neg(zdd_id_t e) {
+  return e <= 1 ? !e : e ^ CMP;
+}
+
+// The LO edge of the family e leads to: a complemented edge passes its
+// complement on, since the empty set lies down the LO branch.
+static inline zdd_id_t lo_of(zdd_id_t e) {
+  zdd_id_t lo = pool_lo[idx(e)];
+  return e & cbit ? neg(lo) : lo;
+}
+
+// Unique table: every node outside a ZDD still under construction is listed
+// here, so equal sub-ZDDs share nodes across the whole pool and equal ZDDs
+// have equal roots. Open addressing with linear probing. An entry holds a
+// node index in the low ID_BITS bits and as much of the hash of the node as
+// fits above it; the key itself lives in the pool. Zero means empty.
+static uint64_t *utab;
+static zdd_id_t utab_mask, utab_count;
+
+static inline zdd_id_t utab_hash(uint32_t t, uint32_t v,
+                                 zdd_id_t lo, zdd_id_t hi) {
+  zdd_id_t h = lo * 0x9e3779b1u ^ hi * 0x85ebca77u ^ v * 0xc2b2ae3du ^
+      t * 0x27d4eb2fu;
+  return h ^ (h >> 15);
+}
+
+static inline int node_is(zdd_id_t n, uint32_t t, uint32_t v,
+                          zdd_id_t lo, zdd_id_t hi) {
+  return pool_lo[n] == lo && pool_hi[n] == hi && pool_v[n] == v &&
+      pool_t[n] == t;
+}
+
+// Brings the node that frees variables t to *v - 1 and tests *v to canonical
+// form. Returns 1 if there is no such node, because it is just *lo.
+static inline int chain_norm(uint32_t t, uint32_t *v,
+                             zdd_id_t *lo, zdd_id_t *hi) {
+  if (!*hi) {
+    // Variable *v must be absent, but those before it are still free,
+    // unless nothing is left at all.
+    if (t == *v || !*lo) return 1;
+    --*v;
+    *hi = *lo;
+  }
+  // Absorb a node that carries on the run of free variables.
+  if (chains && *lo == *hi && pool_t[*lo] == *v + 1) {
+    zdd_id_t n = *lo;
+    *v = pool_v[n];
+    *lo = pool_lo[n];
+    *hi = pool_hi[n];
+  }
+  return 0;
+}
+
+#ifdef ZDD_64
+static inline uint64_t entry(zdd_id_t h, zdd_id_t n) {
+  return (h & ~ID_MASK) | n;
+}
+static inline int entry_has(uint64_t e, zdd_id_t h) {
+  return !((e ^ h) & ~ID_MASK);
+}
+// Too little of the hash is kept to index a big table, so recompute it.
+static inline zdd_id_t entry_hash(uint64_t e) {
+  zdd_id_t n = e & ID_MASK;
+  return utab_hash(pool_t[n], pool_v[n], pool_lo[n], pool_hi[n]);
+}
+#else
+static inline uint64_t entry(zdd_id_t h, zdd_id_t n) {
+  return (uint64_t) h << 32 | n;
+}
+static inline int entry_has(uint64_t e, zdd_id_t h) {
+  return (e >> 32) == h;
+}
+static inline zdd_id_t entry_hash(uint64_t e) {
+  return e >> 32;
+}
+#endif
+
+static inline zdd_id_t entry_node(uint64_t e) {
+  return e & ID_MASK;
+}
+
+static void utab_alloc(zdd_id_t size) {
+  utab = calloc(size, sizeof(*utab));
+  if (!utab) die("out of memory");
+  utab_mask = size - 1;
+}
+
+static void utab_grow() {
+  uint64_t *old = utab;
+  zdd_id_t oldsize = utab_mask + 1;
+  utab_alloc(oldsize << 1);
+  for(zdd_id_t i = 0; i < oldsize; i++) {
+    if (!old[i]) continue;
+    zdd_id_t h = entry_hash(old[i]) & utab_mask;
+    while (utab[h]) h = (h + 1) & utab_mask;
+    utab[h] = old[i];
+  }
+  free(old);
+}
+
+static void utab_insert(zdd_id_t n) {
+  zdd_id_t h = utab_hash(pool_t[n], pool_v[n], pool_lo[n], pool_hi[n]);
+  zdd_id_t i = h & utab_mask;
+  while (utab[i]) i = (i + 1) & utab_mask;
+  utab[i] = entry(h, n);
+  if (2 * ++utab_count > utab_mask) utab_grow();
+}
+
+// Returns the node with the given fields if the unique table has it,
+// otherwise 0.
+static zdd_id_t utab_lookup(uint32_t t, uint32_t v, zdd_id_t lo, zdd_id_t hi) {
+  zdd_id_t h = utab_hash(t, v, lo, hi);
+  for(zdd_id_t i = h & utab_mask; utab[i]; i = (i + 1) & utab_mask) {
+    if (!entry_has(utab[i], h)) continue;
+    zdd_id_t n = entry_node(utab[i]);
+    if (node_is(n, t, v, lo, hi)) return n;
+  }
+  return 0;
+}
+
+// Create or return existing node representing !v ? lo : hi, with variables
+// t to v - 1 free. Nodes whose HI edge points to FALSE are suppressed, and
+// runs of free variables are merged.
+static zdd_id_t unique(uint32_t t, uint32_t v, zdd_id_t lo, zdd_id_t hi) {
+  if (chain_norm(t, &v, &lo, &hi)) return lo;
+  if (cbit && has_empty(lo)) return neg(unique(t, v, neg(lo), hi));
+  zdd_id_t h = utab_hash(t, v, lo, hi);
+  zdd_id_t i = h & utab_mask;
+  for(; utab[i]; i = (i + 1) & utab_mask) {
+    if (!entry_has(utab[i], h)) continue;
+    zdd_id_t n = entry_node(utab[i]);
+    if (node_is(n, t, v, lo, hi)) return n;
+  }
+  pool_need(freenode);
+  set_node(freenode, t, v, lo, hi);
+  if (!(freenode & 0x1ffff)) {
+    printf("freenode = %lx\n", (unsigned long) freenode);
+  }
+  utab[i] = entry(h, freenode);
+  if (2 * ++utab_count > utab_mask) utab_grow();
+  return freenode++;
+}
+
+// Computed table: remembers the results of operations across calls, as in
+// most BDD packages. Direct-mapped, so a new entry simply evicts whatever was
+// in its slot. An op of zero marks an empty slot.
+enum {
+  OP_INTERSECTION = 1,
+  OP_UNION,
+  OP_DIFFERENCE,
+  OP_SYMDIFF,
+  OP_JOIN,
+  OP_MEET,
+  OP_DELTA,
+  OP_QUOTIENT,
+  OP_REMAINDER,
+  OP_NONSUB,
+  OP_NONSUP,
+  OP_SUBSETS,
+  OP_SUPERSETS,
+  OP_MAXIMAL,
+  OP_MINIMAL,
+  OP_ONSET,
+  OP_OFFSET,
+  OP_CHANGE,
+  OP_PROJECT,
+};
+
+struct cache_entry_s {
+  zdd_id_t op, f, g, r;
+};
+typedef struct cache_entry_s *cache_entry_ptr;
+
+enum { CACHE_SIZE = 1 << 18 };
+static struct cache_entry_s cache[CACHE_SIZE];
+
+static inline cache_entry_ptr cache_slot(zdd_id_t op, zdd_id_t f, zdd_id_t g) {
+  zdd_id_t h = f * 0x9e3779b1u ^ g * 0x85ebca77u ^ op * 0xc2b2ae3du;
+  return cache + ((h ^ (h >> 15)) & (CACHE_SIZE - 1));
+}
+
+static int cache_get(zdd_id_t *r, zdd_id_t op, zdd_id_t f, zdd_id_t g) {
+  cache_entry_ptr e = cache_slot(op, f, g);
+  if (e->op != op || e->f != f || e->g != g) return 0;
+  *r = e->r;
+  return 1;
+}
+
+static void cache_put(zdd_id_t op, zdd_id_t f, zdd_id_t g, zdd_id_t r) {
+  cache_entry_ptr e = cache_slot(op, f, g);
+  e->op = op;
+  e->f = f;
+  e->g = g;
+  e->r = r;
+}
+
+// Nodes from b onwards are being renumbered: fwd[i - b] is the new index of
+// node i, or NIL if it is gone. Entries whose nodes all survive are rehashed;
+// the rest are dropped. A NULL fwd drops everything mentioning such nodes.
+static void cache_remap(zdd_id_t b, zdd_id_t end, zdd_id_t *fwd) {
+  zdd_id_t remap(zdd_id_t e) {
+    zdd_id_t n = idx(e);
+    if (n < b) return e;
+    if (!fwd || n >= end || NIL == fwd[n - b]) return NIL;
+    return fwd[n - b] | (e & cbit);
+  }
+  // Take the affected entries out first: rehashing in place could land one
+  // in a slot not yet visited, where it would be remapped a second time.
+  struct cache_entry_s *moved = NULL;
+  zdd_id_t n = 0, cap = 0;
+  for(zdd_id_t i = 0; i < CACHE_SIZE; i++) {
+    cache_entry_ptr e = cache + i;
+    if (!e->op || (idx(e->f) < b && idx(e->g) < b && idx(e->r) < b)) continue;
+    if (n == cap) {
+      cap = cap ? 2 * cap : 1024;
+      moved = realloc(moved, sizeof(*moved) * cap);
+      if (!moved) die("out of memory");
+    }
+    moved[n++] = *e;
+    e->op = 0;
+  }
+  for(zdd_id_t i = 0; i < n; i++) {
+    zdd_id_t f = remap(moved[i].f), g = remap(moved[i].g);
+    zdd_id_t r = remap(moved[i].r);
+    if (f == NIL || g == NIL || r == NIL) continue;
+    cache_put(moved[i].op, f, g, r);
+  }
+  free(moved);
+}
+
+// Template table for zdd_intersection(): maps a pair of operand nodes to the
+// template or node standing for their intersection. zdd_assign() borrows it
+// between melds. Open addressing with
+// linear probing and inline keys; an entry is only valid if its generation
+// matches ttab_gen, so bumping ttab_gen empties the table in O(1).
+struct ttab_entry_s {
+  uint32_t gen;
+  zdd_id_t k0, k1, t;
+};
+typedef struct ttab_entry_s *ttab_entry_ptr;
+
+static ttab_entry_ptr ttab;
+static zdd_id_t ttab_mask, ttab_count;
+static uint32_t ttab_gen;
+
+static inline zdd_id_t ttab_hash(zdd_id_t k0, zdd_id_t k1) {
+  zdd_id_t h = k0 * 0x9e3779b1u ^ k1 * 0x85ebca77u;
+  return h ^ (h >> 15);
+}
+
+static void ttab_alloc(zdd_id_t size) {
+  ttab = calloc(size, sizeof(*ttab));
+  if (!ttab) die("out of memory");
+  ttab_mask = size - 1;
+}
+
+// Empty the table. It keeps the size it grew to, which suits the next meld
+// more often than not.
+static void ttab_reset() {
+  ttab_count = 0;
+  if (ttab) {
+    if (++ttab_gen) return;
+    // Generation wrapped around: stale entries would look live.
+    memset(ttab, 0, (ttab_mask + 1) * sizeof(*ttab));
+    ttab_gen = 1;
+    return;
+  }
+  ttab_alloc(1 << 10);
+  ttab_gen = 1;
+}
+
+static void ttab_grow() {
+  ttab_entry_ptr old = ttab;
+  zdd_id_t oldsize = ttab_mask + 1;
+  ttab_alloc(oldsize << 1);
+  for(zdd_id_t i = 0; i < oldsize; i++) {
+    if (old[i].gen != ttab_gen) continue;
+    zdd_id_t h = ttab_hash(old[i].k0, old[i].k1) & ttab_mask;
+    while (ttab[h].gen == ttab_gen) h = (h + 1) & ttab_mask;
+    ttab[h] = old[i];
+  }
+  free(old);
+}
+
+// Returns the entry for (k0, k1), creating it with t = NIL if it is new.
+static ttab_entry_ptr ttab_at(zdd_id_t k0, zdd_id_t k1) {
+  zdd_id_t h = ttab_hash(k0, k1) & ttab_mask;
+  for(;;) {
+    ttab_entry_ptr e = ttab + h;
+    if (e->gen != ttab_gen) break;
+    if (e->k0 == k0 && e->k1 == k1) return e;
+    h = (h + 1) & ttab_mask;
+  }
+  if (2 * (ttab_count + 1) > ttab_mask) {
+    ttab_grow();
+    return ttab_at(k0, k1);
+  }
+  ttab_count++;
+  ttab_entry_ptr e = ttab + h;
+  e->gen = ttab_gen;
+  e->k0 = k0;
+  e->k1 = k1;
+  e->t = NIL;
+  return e;
+}
+
+// Canonical nodes only point to nodes created before them, so a node always
+// has a larger index than its children. Marks every node in [b, root] that
+// root reaches.
+static char *mark_from(zdd_id_t b, zdd_id_t root) {
+  char *mark = calloc(root >= b ? root - b + 1 : 1, 1);
+  if (root < b) return mark;
+  mark[root - b] = 1;
+  for(zdd_id_t i = root; i >= b && i > 1; i--) {
+    if (!mark[i - b]) continue;
+    zdd_id_t lo = pool_lo[i], hi = idx(pool_hi[i]);
+    if (lo >= b) mark[lo - b] = 1;
+    if (hi >= b) mark[hi - b] = 1;
+  }
+  return mark;
+}
+
+// Lays out the nodes from b onwards that the given roots reach in depth-first
+// postorder, LO before HI: children still precede parents, and a node sits
+// next to its LO child, so later passes in ascending order stream through the
+// pool rather than jumping around it. Sets fwd[i - b] to the new index of node
+// i, or NIL if it is unreachable, and returns the number of survivors, which
+// end up in [b, b + count). The unique table is left to the caller.
+static zdd_id_t relayout(zdd_id_t b, const zdd_id_t *root, int nroot,
+                         zdd_id_t *fwd) {
+  zdd_id_t end = freenode;
+  memset(fwd, 0xff, sizeof(*fwd) * (end - b));
+  // Survivors in their new order.
+  zdd_id_t *list = malloc(sizeof(*list) * (end - b + 1));
+  zdd_id_t out = 0;
+  // Variables strictly increase down the stack.
+  zdd_id_t *stk = malloc(sizeof(*stk) * (vmax + 2));
+  for(int k = 0; k < nroot; k++) {
+    int sp = -1;
+    zdd_id_t r = idx(root[k]);
+    if (r >= b && fwd[r - b] == NIL) stk[++sp] = r;
+    while (sp >= 0) {
+      zdd_id_t i = stk[sp], lo = pool_lo[i], hi = idx(pool_hi[i]);
+      if (lo >= b && fwd[lo - b] == NIL) {
+	stk[++sp] = lo;
+      } else if (hi >= b && fwd[hi - b] == NIL) {
+	stk[++sp] = hi;
+      } else {
+	sp--;
+	if (fwd[i - b] != NIL) continue;
+	list[out] = i;
+	fwd[i - b] = b + out++;
+      }
+    }
+  }
+  free(stk);
+  // Permute one field at a time, so a single buffer suffices.
+  zdd_id_t *tmp = malloc(sizeof(*tmp) * (out + 1));
+  for(zdd_id_t k = 0; k < out; k++) {
+    zdd_id_t lo = pool_lo[list[k]];
+    tmp[k] = lo >= b ? fwd[lo - b] : lo;
+  }
+  memcpy(pool_lo + b, tmp, sizeof(*tmp) * out);
+  for(zdd_id_t k = 0; k < out; k++) {
+    zdd_id_t hi = pool_hi[list[k]], i = idx(hi);
+    tmp[k] = i >= b ? fwd[i - b] | (hi & cbit) : hi;
+  }
+  memcpy(pool_hi + b, tmp, sizeof(*tmp) * out);
+  // A node id is at least as wide as a variable.
+  uint32_t *v = (uint32_t *) tmp;
+  for(zdd_id_t k = 0; k < out; k++) v[k] = pool_v[list[k]];
+  memcpy(pool_v + b, v, sizeof(*v) * out);
+  for(zdd_id_t k = 0; k < out; k++) v[k] = pool_t[list[k]];
+  memcpy(pool_t + b, v, sizeof(*v) * out);
+  free(tmp);
+  free(list);
+  return out;
+}
+
+// Mark-compact garbage collector. Every node some stack entry or handle
+// reaches survives; the rest go, wherever they are in the pool. Survivors are
+// laid out afresh by relayout(), so a collection also undoes the scattering
+// that creation order leaves behind.
+static void gc() {
+  if (raw) die("cannot collect while building");
+  zdd_id_t end = freenode;
+  int nroot = darray_count(stack);
+  zdd_id_t *root = malloc(sizeof(*root) * (nroot + hmax + 1));
+  for(int i = 0; i < darray_count(stack); i++) {
+    root[i] = (zdd_id_t) (uintptr_t) darray_at(stack, i);
+  }
+  for(int h = 0; h < hmax; h++) if (hcount[h]) root[nroot++] = hroot[h];
+  zdd_id_t *fwd = malloc(sizeof(*fwd) * end);
+  fwd[0] = 0;
+  fwd[1] = 1;
+  zdd_id_t out = 2 + relayout(2, root, nroot, fwd + 2);
+  free(root);
+  // Rebuilding the unique table from scratch beats deleting the dead.
+  zdd_id_t size = 1 << 16;
+  while (size < 4 * out) size <<= 1;
+  free(utab);
+  utab_alloc(size);
+  utab_count = 0;
+  for(zdd_id_t i = 2; i < out; i++) utab_insert(i);
+  cache_remap(2, end, fwd + 2);
+  zdd_id_t remap(zdd_id_t r) {
+    return fwd[idx(r)] | (r & cbit);
+  }
+  for(int i = 0; i < darray_count(stack); i++) {
+    zdd_id_t r = (zdd_id_t) (uintptr_t) darray_at(stack, i);
+    darray_raw(stack)[i] = (void *) (uintptr_t) remap(r);
+  }
+  for(int h = 0; h < hmax; h++) if (hcount[h]) hroot[h] = remap(hroot[h]);
+  free(fwd);
+  freenode = out;
+  // Let garbage pile up to about as much as what is live.
+  gc_next = 2 * out > 1 << 20 ? 2 * out : 1 << 20;
+  if (gc_next > pool_max / 2 + out / 2) gc_next = pool_max / 2 + out / 2;
+}
+
+// The parallel engine leaves its nodes from b onwards in any order, with
+// holes, and missing from the unique table. Keeps those root reaches, laid
+// out by relayout(), so the layout does not depend on how threads were
+// scheduled.
+static void renumber(zdd_id_t b, zdd_id_t *root, int nroot) {
+  zdd_id_t end = freenode;
+  zdd_id_t *fwd = malloc(sizeof(*fwd) * (end - b + 1));
+  zdd_id_t out = relayout(b, root, nroot, fwd);
+  for(zdd_id_t i = b; i < b + out; i++) utab_insert(i);
+  for(int k = 0; k < nroot; k++) {
+    zdd_id_t r = root[k];
+    if (idx(r) >= b) root[k] = fwd[idx(r) - b] | (r & cbit);
+  }
+  cache_remap(b, end, fwd);
+  freenode = b + out;
+  free(fwd);
+}
+
+// Lists the nodes node root reaches in ascending order, hence children before
+// parents, starting with the sinks 0 and 1. Returns the length of the list,
+// and sets pos[n] to the position of node n in it for every listed n.
+static zdd_id_t topo(zdd_id_t root, zdd_id_t **list, zdd_id_t **pos) {
+  zdd_id_t top = root > 1 ? root : 1;
+  char *mark = mark_from(2, top);
+  zdd_id_t count = 2;
+  for(zdd_id_t i = 2; i <= top; i++) count += mark[i - 2];
+  zdd_id_t *l = *list = malloc(sizeof(*l) * count);
+  zdd_id_t *p = *pos = malloc(sizeof(*p) * (top + 1));
+  l[0] = p[0] = 0;
+  l[1] = p[1] = 1;
+  for(zdd_id_t i = 2, k = 2; i <= top; i++) {
+    if (mark[i - 2]) p[l[k] = i] = k, k++;
+  }
+  free(mark);
+  return count;
+}
+
+// Replace the ZDD being built by hand on top of the stack with canonical
+// nodes. Duplicate nodes and HI -> FALSE nodes disappear, and any sub-ZDD
+// that already exists elsewhere in the pool is shared.
+//
+// After Sieling and Wegener, the reachable raw nodes are bucket sorted by
+// variable, then reduced one level at a time from the bottom up. Every child
+// of a level is then already canonical, so each node needs a single lookup,
+// and the whole pass takes linear time with no recursion. The new nodes come
+// out level by level, bottom level first.
+static void seal() {
+  if (!raw) return;
+  raw = 0;
+  zdd_id_t b = rawbase, end = freenode;
+  if (b == end) return;
+  zdd_id_t count = end - b;
+  uint32_t *ct = malloc(sizeof(*ct) * count);
+  uint32_t *cv = malloc(sizeof(*cv) * count);
+  zdd_id_t *clo = malloc(sizeof(*clo) * count);
+  zdd_id_t *chi = malloc(sizeof(*chi) * count);
+  memcpy(ct, pool_t + b, sizeof(*ct) * count);
+  memcpy(cv, pool_v + b, sizeof(*cv) * count);
+  memcpy(clo, pool_lo + b, sizeof(*clo) * count);
+  memcpy(chi, pool_hi + b, sizeof(*chi) * count);
+  zdd_id_t *map = malloc(sizeof(*map) * count);
+  memset(map, 0xff, sizeof(*map) * count);
+  freenode = b;
+  // Raw nodes are never the target of a complemented edge.
+  zdd_id_t canon(zdd_id_t i) {
+    return idx(i) < b ? i : map[i - b];
+  }
+  // Find the reachable raw nodes, which get the map entry PENDING. Builders
+  // may point forwards or backwards, so use a worklist.
+  const zdd_id_t PENDING = NIL - 1;
+  zdd_id_t root = (zdd_id_t) (uintptr_t) darray_last(stack);
+  zdd_id_t *list = malloc(sizeof(*list) * count), n = 0;
+  // Some builders stray past vmax on branches that lead nowhere, so sort on
+  // the largest variable actually present.
+  uint32_t vtop = 0;
+  void visit(zdd_id_t i) {
+    if (idx(i) < b) return;
+    if (i >= end) die("node %lu out of range", (unsigned long) i);
+    if (map[i - b] != NIL) return;
+    if (!cv[i - b] || ~0u == cv[i - b]) {
+      die("node %lu has bad variable %u", (unsigned long) i, cv[i - b]);
+    }
+    if (cv[i - b] > vtop) vtop = cv[i - b];
+    map[i - b] = PENDING;
+    list[n++] = i;
+  }
+  visit(root);
+  for(zdd_id_t k = 0; k < n; k++) {
+    visit(clo[list[k] - b]);
+    visit(chi[list[k] - b]);
+  }
+  // Counting sort by variable: level v is sorted[first[v]] up to
+  // sorted[first[v + 1] - 1].
+  zdd_id_t *first = calloc(vtop + 2, sizeof(*first));
+  for(zdd_id_t k = 0; k < n; k++) first[cv[list[k] - b] + 1]++;
+  for(uint32_t v = 1; v <= vtop + 1; v++) first[v] += first[v - 1];
+  zdd_id_t *sorted = malloc(sizeof(*sorted) * (n + 1));
+  for(zdd_id_t k = 0; k < n; k++) {
+    sorted[first[cv[list[k] - b]]++] = list[k];
+  }
+  // Placing shifted each first[v] to where level v + 1 begins.
+  for(uint32_t v = vtop + 1; v >= 1; v--) first[v] = first[v - 1];
+  first[0] = 0;
+  free(list);
+  for(uint32_t v = vtop; v >= 1; v--) {
+    for(zdd_id_t k = first[v]; k < first[v + 1]; k++) {
+      zdd_id_t i = sorted[k];
+      zdd_id_t lo = canon(clo[i - b]), hi = canon(chi[i - b]);
+      if (PENDING == lo || PENDING == hi) {
+	die("node %lu is out of order", (unsigned long) i);
+      }
+      map[i - b] = unique(ct[i - b], v, lo, hi);
+    }
+  }
+  free(sorted);
+  free(first);
+  root = canon(root);
+  darray_remove_last(stack);
+  darray_append(stack, (void *) (uintptr_t) root);
+  free(map);
+  free(ct);
+  free(cv);
+  free(clo);
+  free(chi);
+}
+
+// Dynamic variable reordering, after Rudell: a variable is sifted through
+// every level by swapping adjacent levels, then left where the ZDDs were
+// smallest. A swap rewrites the nodes of the upper level in place, so
+// parents and roots stay valid, and only the two levels involved are
+// touched. Reference counts tell live nodes from those a swap orphans.
+//
+// During a session the unique table is left stale; each swap hashes the
+// nodes of the level it builds by itself. A collection at the end rebuilds
+// the table and restores the order of the pool.
+static zdd_id_t *sift_ref, sift_refcap, sift_live;
+static zdd_id_t *sift_stk;
+struct sift_level_s {
+  zdd_id_t *n, count, max;
+} *sift_lv;
+
+static void sift_append(struct sift_level_s *l, zdd_id_t n) {
+  if (l->count == l->max) {
+    l->max = l->max ? 2 * l->max : 16;
+    l->n = realloc(l->n, sizeof(*l->n) * l->max);
+  }
+  l->n[l->count++] = n;
+}
+
+// A live node holds a reference to each child; a dead one holds none. So
+// reviving or killing a node ripples down. Children lie on deeper levels,
+// so the stack holds at most two nodes per level.
+static void sift_inc(zdd_id_t n) {
+  int sp = 0;
+  sift_stk[sp++] = n;
+  while (sp) {
+    zdd_id_t m = sift_stk[--sp];
+    if (m < 2 || sift_ref[m]++) continue;
+    sift_live++;
+    sift_stk[sp++] = pool_lo[m];
+    sift_stk[sp++] = pool_hi[m];
+  }
+}
+
+static void sift_dec(zdd_id_t n) {
+  int sp = 0;
+  sift_stk[sp++] = n;
+  while (sp) {
+    zdd_id_t m = sift_stk[--sp];
+    if (m < 2 || --sift_ref[m]) continue;
+    sift_live--;
+    sift_stk[sp++] = pool_lo[m];
+    sift_stk[sp++] = pool_hi[m];
+  }
+}
+
+static void sift_begin() {
+  if (raw) die("cannot reorder while building");
+  if (chains || cbit) die("reordering needs plain nodes");
+  gc();
+  sift_refcap = 2 * freenode;
+  sift_ref = calloc(sift_refcap, sizeof(*sift_ref));
+  sift_stk = malloc(sizeof(*sift_stk) * 2 * (vmax + 2));
+  sift_lv = calloc(vmax + 2, sizeof(*sift_lv));
+  sift_live = 0;
+  for(int i = 0; i < darray_count(stack); i++) {
+    sift_inc((zdd_id_t) (uintptr_t) darray_at(stack, i));
+  }
+  for(int h = 0; h < hmax; h++) if (hcount[h]) sift_inc(hroot[h]);
+  for(zdd_id_t n = 2; n < freenode; n++) {
+    if (sift_ref[n]) sift_append(sift_lv + pool_v[n], n);
+  }
+}
+
+static void sift_end() {
+  for(uint32_t l = 0; l <= vmax + 1; l++) free(sift_lv[l].n);
+  free(sift_lv);
+  free(sift_stk);
+  free(sift_ref);
+  reordered = 0;
+  for(uint32_t l = 1; l <= vmax; l++) reordered |= lvl_var[l] != l;
+  reorder_count++;
+  gc();
+}
+
+// Swaps levels i and i + 1. Call x the variable at level i and y the one
+// below. A node testing x that ignores y moves down a level as is. One that
+// depends on y is rewritten in place to test y, with children testing x
+// made from the four cofactors. Nodes testing y move up a level.
+static void sift_swap(uint32_t i) {
+  struct sift_level_s *lx = sift_lv + i, *ly = sift_lv + i + 1;
+  struct sift_level_s nx = {0}, ny = {0};
+  // Cofactors of the nodes that depend on y, four to a node.
+  zdd_id_t *dep = malloc(sizeof(*dep) * 5 * (lx->count + 1)), ndep = 0;
+  zdd_id_t size = 16;
+  while (size < 4 * (3 * lx->count + 1)) size <<= 1;
+  zdd_id_t *tab = calloc(size, sizeof(*tab)), mask = size - 1;
+  zdd_id_t *slot(zdd_id_t lo, zdd_id_t hi) {
+    zdd_id_t j = utab_hash(i + 1, i + 1, lo, hi) & mask;
+    for(; tab[j]; j = (j + 1) & mask) {
+      zdd_id_t n = tab[j];
+      if (pool_lo[n] == lo && pool_hi[n] == hi) break;
+    }
+    return tab + j;
+  }
+  void cofactor(zdd_id_t g, zdd_id_t *c) {
+    if (pool_v[g] == i + 1) {
+      c[0] = pool_lo[g];
+      c[1] = pool_hi[g];
+    } else {
+      c[0] = g;
+      c[1] = 0;
+    }
+  }
+  for(zdd_id_t k = 0; k < lx->count; k++) {
+    zdd_id_t n = lx->n[k];
+    if (!sift_ref[n]) continue;
+    if (pool_v[pool_lo[n]] == i + 1 || pool_v[pool_hi[n]] == i + 1) {
+      zdd_id_t *d = dep + 5 * ndep++;
+      d[0] = n;
+      cofactor(pool_lo[n], d + 1);
+      cofactor(pool_hi[n], d + 3);
+    } else {
+      set_node(n, i + 1, i + 1, pool_lo[n], pool_hi[n]);
+      *slot(pool_lo[n], pool_hi[n]) = n;
+      sift_append(&ny, n);
+    }
+  }
+  for(zdd_id_t k = 0; k < ly->count; k++) {
+    zdd_id_t n = ly->n[k];
+    if (!sift_ref[n]) continue;
+    set_node(n, i, i, pool_lo[n], pool_hi[n]);
+    sift_append(&nx, n);
+  }
+  // A node testing x, on level i + 1.
+  zdd_id_t mk(zdd_id_t lo, zdd_id_t hi) {
+    if (!hi) return lo;
+    zdd_id_t *p = slot(lo, hi);
+    if (*p) return *p;
+    if (freenode >= pool_max) die("pool is full");
+    pool_need(freenode);
+    if (freenode >= sift_refcap) {
+      sift_ref = realloc(sift_ref, sizeof(*sift_ref) * 2 * sift_refcap);
+      memset(sift_ref + sift_refcap, 0, sizeof(*sift_ref) * sift_refcap);
+      sift_refcap *= 2;
+    }
+    set_node(freenode, i + 1, i + 1, lo, hi);
+    sift_append(&ny, freenode);
+    return *p = freenode++;
+  }
+  for(zdd_id_t k = 0; k < ndep; k++) {
+    zdd_id_t *d = dep + 5 * k, n = d[0];
+    // d[1], d[2]: x out, y out and in; d[3], d[4]: x in, y out and in.
+    zdd_id_t lo = mk(d[1], d[3]), hi = mk(d[2], d[4]);
+    sift_inc(lo);
+    sift_inc(hi);
+    sift_dec(pool_lo[n]);
+    sift_dec(pool_hi[n]);
+    set_node(n, i, i, lo, hi);
+    sift_append(&nx, n);
+  }
+  free(dep);
+  free(tab);
+  free(lx->n);
+  free(ly->n);
+  *lx = nx;
+  *ly = ny;
+  uint32_t x = lvl_var[i];
+  lvl_var[i] = lvl_var[i + 1];
+  lvl_var[i + 1] = x;
+  var_lvl[lvl_var[i]] = i;
+  var_lvl[lvl_var[i + 1]] = i + 1;
+}
+
+// Node counts by variable, for sift_cmp(). A comparator that captured them
+// would need a trampoline, and so an executable stack.
+static zdd_id_t *sift_size;
+
+// Orders variables by decreasing node count.
+static int sift_cmp(const void *a, const void *b) {
+  zdd_id_t p = sift_size[*(const uint32_t *) a];
+  zdd_id_t q = sift_size[*(const uint32_t *) b];
+  return (p < q) - (p > q);
+}
+
+// Sifts every variable in turn, those on the most populous levels first.
+// A variable stops moving in a direction once the live nodes outnumber the
+// best seen so far by a fifth.
+static void sift() {
+  sift_begin();
+  uint32_t *var = malloc(sizeof(*var) * (vmax + 1));
+  zdd_id_t *size = sift_size = malloc(sizeof(*size) * (vmax + 1));
+  for(uint32_t l = 1; l <= vmax; l++) {
+    var[l - 1] = lvl_var[l];
+    size[lvl_var[l]] = sift_lv[l].count;
+  }
+  qsort(var, vmax, sizeof(*var), sift_cmp);
+  for(uint32_t k = 0; k < vmax; k++) {
+    // A variable no node tests can move anywhere at no cost or gain.
+    if (!size[var[k]]) break;
+    uint32_t l = var_lvl[var[k]], best = l;
+    zdd_id_t least = sift_live;
+    int too_big() {
+      if (sift_live < least) least = sift_live, best = l;
+      return 5 * sift_live > 6 * least;
+    }
+    // Nearer end first.
+    int down = vmax - l < l - 1;
+    for(int pass = 0; pass < 2; pass++, down = !down) {
+      if (down) {
+	while (l < vmax) {
+	  sift_swap(l++);
+	  if (too_big()) break;
+	}
+      } else {
+	while (l > 1) {
+	  sift_swap(--l);
+	  if (too_big()) break;
+	}
+      }
+    }
+    while (l < best) sift_swap(l++);
+    while (l > best) sift_swap(--l);
+  }
+  free(var);
+  free(size);
+  sift_end();
+}
+
+void zdd_set_engine(int e) {
+  engine = e;
+}
+
+// Node formats may only change while the pool holds nothing but the sinks.
+// Dead nodes are collected first.
+static void pool_empty_check() {
+  int live = raw || darray_count(stack);
+  for(int h = 0; h < hmax; h++) live |= !!hcount[h];
+  if (freenode > 2 && !live) gc();
+  if (freenode > 2) die("nodes already made");
+}
+
+void zdd_set_chains(int on) {
+  pool_empty_check();
+  chains = !!on;
+  if (chains) cbit = 0, reorder_min = 0;
+}
+
+void zdd_set_complement(int on) {
+  pool_empty_check();
+  cbit = on ? CMP : 0;
+  if (!cbit) return;
+  chains = 0;
+  reorder_min = 0;
+  // Node ids must leave the complement bit alone.
+  if (pool_max >= CMP) pool_max = CMP - 1;
+}
+
+void zdd_set_threads(int n) {
+  if (n < 1) die("need at least 1 thread");
+  if (workers && n != nthreads) stop_workers();
+  nthreads = n;
+}
+
+int zdd_threads() { return nthreads; }
+
+void zdd_set_pool_max(zdd_id_t n) {
+  if (pool_v) die("pool already reserved");
+  if (n < 2 || n > ID_LIMIT) die("bad pool size %lu", (unsigned long) n);
+  pool_max = n;
+}
+
+uint32_t zdd_set_vmax(int i) {
+  if (i < 0) die("bad vmax %d", i);
+  // Going back to the identity order would change the family of every
+  // node built under another one, and nodes below a smaller vmax would
+  // overrun the stacks sized by it.
+  if (reordered || (vmax_is_set && (uint32_t) i < vmax)) pool_empty_check();
+  vmax_is_set = 1;
+  vmax = i;
+  lvl_var = realloc(lvl_var, sizeof(*lvl_var) * (vmax + 2));
+  var_lvl = realloc(var_lvl, sizeof(*var_lvl) * (vmax + 2));
+  for(uint32_t l = 0; l <= vmax + 1; l++) lvl_var[l] = var_lvl[l] = l;
+  reordered = 0;
+  return vmax;
+}
+
+void vmax_check() {
+  if (!vmax_is_set) die("vmax not set");
+}
+
+void zdd_set_reorder(zdd_id_t threshold) {
+  if (threshold && (chains || cbit)) {
+    pool_empty_check();
+    chains = 0;
+    cbit = 0;
+  }
+  reorder_min = reorder_next = threshold;
+}
+
+zdd_id_t zdd_reorder() {
+  vmax_check();
+  seal();
+  sift();
+  return freenode;
+}
+
+void zdd_swap(uint32_t level) {
+  vmax_check();
+  if (level < 1 || level >= vmax) die("bad level %u", level);
+  seal();
+  sift_begin();
+  sift_swap(level);
+  sift_end();
+}
+
+uint32_t zdd_var(uint32_t level) { return lvl_var[level]; }
+uint32_t zdd_level(uint32_t var) { return var_lvl[var]; }
+
+void zdd_push() {
+  seal();
+  darray_append(stack, (void *) (uintptr_t) freenode);
+  rawbase = freenode;
+  raw = 1;
+}
+
+// The nodes of a popped ZDD stay until the next collection, as handles or
+// other stack entries may share them.
+void zdd_pop() {
+  darray_remove_last(stack);
+  if (raw) freenode = rawbase;
+  raw = 0;
+}
+
+void zdd_gc() {
+  seal();
+  gc();
+}
+
+zdd_id_t zdd_reduce() {
+  seal();
+  return (zdd_id_t) (uintptr_t) darray_last(stack);
+}
+
+int zdd_keep() {
+  zdd_id_t root = zdd_root();
+  int h;
+  for(h = 0; h < hmax && hcount[h]; h++);
+  if (h == hmax) {
+    hmax = hmax ? 2 * hmax : 16;
+    hroot = realloc(hroot, sizeof(*hroot) * hmax);
+    hcount = realloc(hcount, sizeof(*hcount) * hmax);
+    memset(hcount + h, 0, sizeof(*hcount) * (hmax - h));
+  }
+  hroot[h] = root;
+  hcount[h] = 1;
+  return h;
+}
+
+static void handle_check(int h) {
+  if (h < 0 || h >= hmax || !hcount[h]) die("bad handle %d", h);
+}
+
+void zdd_ref(int h) {
+  handle_check(h);
+  hcount[h]++;
+}
+
+void zdd_release(int h) {
+  handle_check(h);
+  hcount[h]--;
+}
+
+void zdd_load(int h) {
+  handle_check(h);
+  seal();
+  darray_append(stack, (void *) (uintptr_t) hroot[h]);
+}
+
+uint32_t zdd_v(zdd_id_t n) { return pool_v[idx(n)]; }
+uint32_t zdd_top(zdd_id_t n) { return pool_t[idx(n)]; }
+zdd_id_t zdd_hi(zdd_id_t n) { return pool_hi[idx(n)]; }
+zdd_id_t zdd_lo(zdd_id_t n) { return lo_of(n); }
+zdd_id_t zdd_set_lo(zdd_id_t n, zdd_id_t lo) { return pool_lo[n] = lo; }
+zdd_id_t zdd_set_hi(zdd_id_t n, zdd_id_t hi) { return pool_hi[n] = hi; }
+zdd_id_t zdd_set_hilo(zdd_id_t n, zdd_id_t hilo) {
+  return pool_lo[n] = pool_hi[n] = hilo;
+}
+zdd_id_t zdd_next_node() { return freenode; }
+zdd_id_t zdd_last_node() { return freenode - 1; }
+
+zdd_id_t zdd_root() {
+  seal();
+  return (zdd_id_t) (uintptr_t) darray_last(stack);
+}
+
+zdd_id_t zdd_set_root(zdd_id_t root) {
+  darray_remove_last(stack);
+  darray_append(stack, (void *) (uintptr_t) root);
+  return root;
+}
+
+void zdd_count(mpz_ptr z) {
+  zdd_id_t *list, *pos;
+  zdd_id_t r = zdd_root(), s = topo(idx(r), &list, &pos);
+  // Count elements in ZDD rooted at each node, bottom-up.
+  mpz_t *count = malloc(sizeof(*count) * s);
+  mpz_init_set_ui(count[0], 0);
+  mpz_init_set_ui(count[1], 1);
+  for(zdd_id_t k = 2; k < s; k++) {
+    zdd_id_t n = list[k];
+    mpz_init(count[k]);
+    zdd_id_t hi = pool_hi[n];
+    mpz_add(count[k], count[pos[pool_lo[n]]], count[pos[idx(hi)]]);
+    // A complemented edge adds the empty set.
+    if (hi & cbit) mpz_add_ui(count[k], count[k], 1);
+    // Each free variable doubles the count.
+    mpz_mul_2exp(count[k], count[k], pool_v[n] - pool_t[n]);
+  }
+  mpz_set(z, count[pos[idx(r)]]);
+  if (r & cbit) mpz_add_ui(z, z, 1);
+  for(zdd_id_t k = 0; k < s; k++) mpz_clear(count[k]);
+  free(count);
+  free(list);
+  free(pos);
+}
+
+void zdd_count_1(restrict mpz_ptr z0, restrict mpz_ptr z1) {
+  zdd_id_t *list, *pos;
+  zdd_id_t r = zdd_root(), s = topo(idx(r), &list, &pos);
+  // Count elements in ZDD rooted at each node, bottom-up.
+  // Along with total size of solutions.
+  mpz_t *count = malloc(sizeof(*count) * s);
+  mpz_t *total = malloc(sizeof(*total) * s);
+  for(zdd_id_t k = 0; k < s; k++) {
+    mpz_init(count[k]);
+    mpz_init(total[k]);
+  }
+  mpz_set_ui(count[1], 1);
+  // total[0], total[1] should be zero.
+  for(zdd_id_t k = 2; k < s; k++) {
+    zdd_id_t hi = pool_hi[list[k]];
+    zdd_id_t x = pos[pool_lo[list[k]]], y = pos[idx(hi)];
+    mpz_add(count[k], count[x], count[y]);
+    mpz_add(total[k], total[x], total[y]);
+    mpz_add(total[k], total[k], count[y]);
+    // A complemented HI edge adds the set holding just this variable.
+    if (hi & cbit) {
+      mpz_add_ui(count[k], count[k], 1);
+      mpz_add_ui(total[k], total[k], 1);
+    }
+    // With d free variables, the 2^d choices for them contribute
+    // d 2^(d-1) elements between them.
+    unsigned long d = pool_v[list[k]] - pool_t[list[k]];
+    if (d) {
+      mpz_mul_2exp(total[k], total[k], 1);
+      mpz_addmul_ui(total[k], count[k], d);
+      mpz_mul_2exp(total[k], total[k], d - 1);
+      mpz_mul_2exp(count[k], count[k], d);
+    }
+  }
+  mpz_set(z0, count[pos[idx(r)]]);
+  mpz_set(z1, total[pos[idx(r)]]);
+  if (r & cbit) mpz_add_ui(z0, z0, 1);
+  for(zdd_id_t k = 0; k < s; k++) {
+    mpz_clear(count[k]);
+    mpz_clear(total[k]);
+  }
+  free(count);
+  free(total);
+  free(list);
+  free(pos);
+}
+
+// Compute 0, 1, 2 power sums of sizes of sets.
+void zdd_count_2(restrict mpz_ptr z0,
+                 restrict mpz_ptr z1,
+		 restrict mpz_ptr z2) {
+  zdd_id_t *list, *pos;
+  zdd_id_t r = zdd_root(), s = topo(idx(r), &list, &pos);
+  mpz_t *t0 = malloc(sizeof(*t0) * s);
+  mpz_t *t1 = malloc(sizeof(*t1) * s);
+  mpz_t *t2 = malloc(sizeof(*t2) * s);
+  for(zdd_id_t k = 0; k < s; k++) {
+    mpz_init(t0[k]);
+    mpz_init(t1[k]);
+    mpz_init(t2[k]);
+  }
+  // t0[1] should be 1.
+  // t1[n], t2[n] should be zero.
+  // Another reason why 0^0 = 1.
+  mpz_set_ui(t0[1], 1);
+  for(zdd_id_t k = 2; k < s; k++) {
+    zdd_id_t hi = pool_hi[list[k]];
+    zdd_id_t x = pos[pool_lo[list[k]]], y = pos[idx(hi)];
+    mpz_add(t0[k], t0[x], t0[y]);
+    mpz_add(t1[k], t1[x], t1[y]);
+    mpz_add(t1[k], t1[k], t0[y]);
+    mpz_add(t2[k], t2[x], t2[y]);
+    mpz_addmul_ui(t2[k], t1[y], 2);
+    mpz_add(t2[k], t2[k], t0[y]);
+    // A complemented HI edge adds the set holding just this variable.
+    if (hi & cbit) {
+      mpz_add_ui(t0[k], t0[k], 1);
+      mpz_add_ui(t1[k], t1[k], 1);
+      mpz_add_ui(t2[k], t2[k], 1);
+    }
+    // With d free variables, the sizes X of the 2^d choices for them sum to
+    // d 2^(d-1), and their squares to d(d+1) 2^(d-2). Expand (X + Y)^2.
+    unsigned long d = pool_v[list[k]] - pool_t[list[k]];
+    if (d) {
+      mpz_mul_2exp(t2[k], t2[k], 1);
+      mpz_addmul_ui(t2[k], t1[k], 2 * d);
+      mpz_addmul_ui(t2[k], t0[k], d * (d + 1) / 2);
+      mpz_mul_2exp(t2[k], t2[k], d - 1);
+      mpz_mul_2exp(t1[k], t1[k], 1);
+      mpz_addmul_ui(t1[k], t0[k], d);
+      mpz_mul_2exp(t1[k], t1[k], d - 1);
+      mpz_mul_2exp(t0[k], t0[k], d);
+    }
+  }
+  mpz_set(z0, t0[pos[idx(r)]]);
+  mpz_set(z1, t1[pos[idx(r)]]);
+  mpz_set(z2, t2[pos[idx(r)]]);
+  if (r & cbit) mpz_add_ui(z0, z0, 1);
+  for(zdd_id_t k = 0; k < s; k++) {
+    mpz_clear(t0[k]);
+    mpz_clear(t1[k]);
+    mpz_clear(t2[k]);
+  }
+  free(t0);
+  free(t1);
+  free(t2);
+  free(list);
+  free(pos);
+}
+
+zdd_id_t zdd_abs_node(uint32_t v, zdd_id_t lo, zdd_id_t hi) {
+  pool_need(freenode);
+  set_node(freenode, v, v, lo, hi);
+  return freenode++;
+}
+
+zdd_id_t zdd_add_node(uint32_t v, int offlo, int offhi) {
+  zdd_id_t n = freenode;
+  pool_need(n);
+  zdd_id_t adjust(int off) {
+    if (!off) return 0;
+    if (-1 == off) return 1;
+    return n + off;
+  }
+  set_node(n, v, v, adjust(offlo), adjust(offhi));
+  return freenode++;
+}
+
+// Prepares the pair (k0, k1) of operand nodes for intersection. Returns 1
+// and sets *r if the answer is immediate. Otherwise k0 < k1, and from the
+// later of their first variables on, both still have a variable to test.
+// The pair is then untagged: *r is 1 if the intersection of the untagged
+// pair must still have the empty set toggled, and 0 otherwise.
+static int meld_pair(zdd_id_t *k0, zdd_id_t *k1, zdd_id_t *r) {
+  zdd_id_t a = *k0, b = *k1;
+  int tag = 0;
+  if (cbit) {
+    // With complement edges, no stored node but TRUE holds the empty set.
+    // Set it aside: it is in the intersection if it is in both operands.
+    tag = has_empty(a) && has_empty(b);
+    a = 1 == a ? 0 : idx(a);
+    b = 1 == b ? 0 : idx(b);
+  }
+  // Skip variables that only one side has; they are absent from the
+  // intersection. A side whose run of free variables reaches past the
+  // other's first variable just starts later. TRUE sorts after every
+  // variable, so against TRUE we follow the LO chain of the other side down
+  // to a sink.
+  while (a && b && a != b) {
+    uint32_t s = pool_t[a] > pool_t[b] ? pool_t[a] : pool_t[b];
+    if (pool_v[a] < s) a = pool_lo[a];
+    else if (pool_v[b] < s) b = pool_lo[b];
+    else break;
+  }
+  if (!a || !b || a == b) {
+    *r = a && b ? a : 0;
+    if (tag) *r = neg(*r);
+    return 1;
+  }
+  *r = tag;
+  // Taking advantage of symmetry of intersection appears to help a tiny
+  // bit.
+  if (a > b) {
+    *k0 = b;
+    *k1 = a;
+  } else {
+    *k0 = a;
+    *k1 = b;
+  }
+  return 0;
+}
+
+// For a pair prepared by meld_pair(), finds the node at the top of the
+// intersection: it frees variables *s to *m - 1 and tests *m, and its LO and
+// HI edges lead to the intersections of the pairs (c[0], c[1]) and
+// (c[2], c[3]). A side whose free run goes on past *m is passed down whole;
+// the other side of the pair only has later variables, so that trims it.
+static inline void meld_split(zdd_id_t k0, zdd_id_t k1,
+                              uint32_t *s, uint32_t *m, zdd_id_t c[4]) {
+  uint32_t v0 = pool_v[k0], v1 = pool_v[k1];
+  *s = pool_t[k0] > pool_t[k1] ? pool_t[k0] : pool_t[k1];
+  *m = v0 < v1 ? v0 : v1;
+  c[0] = v0 == *m ? pool_lo[k0] : k0;
+  c[1] = v1 == *m ? pool_lo[k1] : k1;
+  c[2] = v0 == *m ? pool_hi[k0] : k0;
+  c[3] = v1 == *m ? pool_hi[k1] : k1;
+}
+
+// Depth-first engine. Leaves the intersection of z0 and z1 as canonical nodes
+// from freenode onwards and returns its root.
+static zdd_id_t meld_dfs(zdd_id_t z0, zdd_id_t z1) {
+  // Following Knuth, we meld in the pool itself. Templates are laid out from
+  // freenode onwards, each one after its children, so a template's fields
+  // are those of a node, except LO and HI may refer to other templates.
+  // References below tbase are existing nodes.
+  zdd_id_t tbase = freenode, tfree = freenode;
+  ttab_reset();
+
+  // Depth-first with an explicit stack. Variables strictly increase down the
+  // stack, so it never holds more than vmax + 1 frames.
+  struct frame_s {
+    zdd_id_t k0, k1, lo;
+    // 0: new pair, 1: LO result pending, 2: HI result pending.
+    char state;
+    // Whether the result gets the empty set toggled; see meld_pair().
+    char tag;
+  } *stk = malloc(sizeof(*stk) * (vmax + 2));
+  int sp = 0;
+  zdd_id_t ret = 0, c[4];
+  uint32_t s, m;
+  stk[0].k0 = z0;
+  stk[0].k1 = z1;
+  stk[0].state = 0;
+  while (sp >= 0) {
+    struct frame_s *f = stk + sp;
+    zdd_id_t k0 = f->k0, k1 = f->k1;
+    if (0 == f->state) {
+      if (meld_pair(&k0, &k1, &ret)) {
+	sp--;
+	continue;
+      }
+      char tag = ret;
+      ttab_entry_ptr e = ttab_at(k0, k1);
+      if (e->t != NIL) {
+	ret = tag ? neg(e->t) : e->t;
+	sp--;
+	continue;
+      }
+      if (cache_get(&ret, OP_INTERSECTION, k0, k1)) {
+	e->t = ret;
+	if (tag) ret = neg(ret);
+	sp--;
+	continue;
+      }
+      f->k0 = k0;
+      f->k1 = k1;
+      f->tag = tag;
+      f->state = 1;
+      meld_split(k0, k1, &s, &m, c);
+      f[1].k0 = c[0];
+      f[1].k1 = c[1];
+      f[1].state = 0;
+      sp++;
+      continue;
+    }
+    meld_split(k0, k1, &s, &m, c);
+    if (1 == f->state) {
+      f->lo = ret;
+      if (!(c[0] == c[2] && c[1] == c[3])) {
+	f->state = 2;
+	f[1].k0 = c[2];
+	f[1].k1 = c[3];
+	f[1].state = 0;
+	sp++;
+	continue;
+      }
+      // Both sides ignore this variable, so HI is the same as LO.
+    }
+    zdd_id_t lo = f->lo, hi = ret;
+    // Remove HI edges pointing to FALSE right away, and merge free runs.
+    if (chain_norm(s, &m, &lo, &hi)) ret = lo;
+    else {
+      // A LO edge may not lead to the empty set; move it up to the result.
+      int flip = cbit && has_empty(lo);
+      if (flip) lo = neg(lo);
+      pool_need(tfree);
+      ret = tfree++;
+      set_node(ret, s, m, lo, hi);
+      if (flip) ret = neg(ret);
+    }
+    ttab_at(k0, k1)->t = ret;
+    if (f->tag) ret = neg(ret);
+    sp--;
+  }
+  free(stk);
+  zdd_id_t root = ret;
+
+  // Convert templates to nodes in place. Children precede parents, so one
+  // pass suffices. A template that turns out to duplicate an existing node
+  // becomes a forwarding slot: v = 0 and LO holds the node. Two templates
+  // may forward to the same node, so a template may only now find that its
+  // LO and HI edges agree, and merge with its child.
+  zdd_id_t resolve(zdd_id_t t) {
+    zdd_id_t i = idx(t);
+    if (i < tbase || pool_v[i]) return t;
+    return t == i ? pool_lo[i] : neg(pool_lo[i]);
+  }
+  for(zdd_id_t t = tbase; t < tfree; t++) {
+    uint32_t top = pool_t[t], v = pool_v[t];
+    zdd_id_t lo = resolve(pool_lo[t]), hi = resolve(pool_hi[t]);
+    chain_norm(top, &v, &lo, &hi);
+    set_node(t, top, v, lo, hi);
+    zdd_id_t h = utab_hash(top, v, lo, hi);
+    zdd_id_t i = h & utab_mask;
+    for(; utab[i]; i = (i + 1) & utab_mask) {
+      if (!entry_has(utab[i], h)) continue;
+      if (node_is(entry_node(utab[i]), top, v, lo, hi)) break;
+    }
+    if (utab[i]) {
+      pool_v[t] = 0;
+      pool_lo[t] = entry_node(utab[i]);
+    } else {
+      if (!(t & 0x1ffff)) printf("freenode = %lx\n", (unsigned long) t);
+      utab[i] = entry(h, t);
+      if (2 * ++utab_count > utab_mask) utab_grow();
+    }
+  }
+  root = resolve(root);
+  freenode = tfree;
+
+  for(zdd_id_t i = 0; i <= ttab_mask; i++) {
+    ttab_entry_ptr e = ttab + i;
+    if (e->gen == ttab_gen) cache_put(OP_INTERSECTION, e->k0, e->k1, resolve(e->t));
+  }
+  return root;
+}
+
+// Breadth-first engine, after Ochi et al. and Sylvan: requests for pairs of
+// nodes are queued by variable and expanded one level at a time, top-down.
+// Each level's queue is sorted and deduplicated first, so the operands are
+// read in pool order. Then the levels are reduced bottom-up, so the result
+// is built with canonical nodes straight away.
+struct req_s {
+  zdd_id_t k0, k1;
+  // A child is a node, or REQ | i for request i of the level in lov or hiv,
+  // with CMP also set if the result gets the empty set toggled.
+  zdd_id_t lo, hi;
+  uint32_t lov, hiv;
+};
+
+#define REQ ((zdd_id_t) 1 << (ID_BITS - 1))
+
+struct level_s {
+  struct req_s *req;
+  zdd_id_t n, max;
+  // canon[i] is the rank of request i among distinct requests, and order
+  // lists the first request of each rank.
+  zdd_id_t *canon, *order, count;
+  // Result node for each rank.
+  zdd_id_t *out;
+};
+
+// A pair of node ids packed into one integer ordered like the pair.
+#ifdef ZDD_64
+typedef unsigned __int128 pair_t;
+#else
+typedef uint64_t pair_t;
+#endif
+
+struct sortkey_s {
+  pair_t k;
+  zdd_id_t i;
+};
+
+static int sortkey_cmp(const void *a, const void *b) {
+  const struct sortkey_s *x = a, *y = b;
+  if (x->k != y->k) return x->k < y->k ? -1 : 1;
+  return x->i < y->i ? -1 : x->i > y->i;
+}
+
+static zdd_id_t meld_bfs(zdd_id_t z0, zdd_id_t z1) {
+  struct level_s *lev = calloc(vmax + 1, sizeof(*lev));
+  // Returns the child for the pair (k0, k1), queueing a request if needed.
+  zdd_id_t child(zdd_id_t k0, zdd_id_t k1, uint32_t *v) {
+    zdd_id_t r;
+    if (meld_pair(&k0, &k1, &r)) return r;
+    zdd_id_t tag = r ? CMP : 0;
+    if (cache_get(&r, OP_INTERSECTION, k0, k1)) return tag ? neg(r) : r;
+    *v = pool_t[k0] > pool_t[k1] ? pool_t[k0] : pool_t[k1];
+    struct level_s *l = lev + *v;
+    if (l->n == l->max) {
+      l->max = l->max ? 2 * l->max : 64;
+      l->req = realloc(l->req, sizeof(*l->req) * l->max);
+    }
+    l->req[l->n].k0 = k0;
+    l->req[l->n].k1 = k1;
+    return REQ | tag | l->n++;
+  }
+  zdd_id_t resolve(zdd_id_t r, uint32_t v) {
+    if (!(r & REQ)) return r;
+    struct level_s *l = lev + v;
+    zdd_id_t n = l->out[l->canon[r & ~(REQ | CMP)]];
+    return r & CMP ? neg(n) : n;
+  }
+  uint32_t rootv = 0;
+  zdd_id_t root = child(z0, z1, &rootv);
+
+  for(zdd_id_t v = 1; v <= vmax; v++) {
+    struct level_s *l = lev + v;
+    if (!l->n) continue;
+    struct sortkey_s *key = malloc(sizeof(*key) * l->n);
+    for(zdd_id_t i = 0; i < l->n; i++) {
+      key[i].k = (pair_t) l->req[i].k0 << ID_BITS | l->req[i].k1;
+      key[i].i = i;
+    }
+    qsort(key, l->n, sizeof(*key), sortkey_cmp);
+    l->canon = malloc(sizeof(*l->canon) * l->n);
+    l->order = malloc(sizeof(*l->order) * l->n);
+    l->count = 0;
+    for(zdd_id_t j = 0; j < l->n; j++) {
+      if (j && key[j].k == key[j - 1].k) {
+	l->canon[key[j].i] = l->count - 1;
+	continue;
+      }
+      zdd_id_t i = key[j].i;
+      l->canon[i] = l->count;
+      l->order[l->count++] = i;
+      struct req_s *q = l->req + i;
+      uint32_t s, m;
+      zdd_id_t c[4];
+      meld_split(q->k0, q->k1, &s, &m, c);
+      q->lo = child(c[0], c[1], &q->lov);
+      if (c[0] == c[2] && c[1] == c[3]) {
+	// Both sides ignore this variable, so HI is the same as LO.
+	q->hi = q->lo;
+	q->hiv = q->lov;
+      } else {
+	q->hi = child(c[2], c[3], &q->hiv);
+      }
+    }
+    free(key);
+  }
+
+  for(zdd_id_t v = vmax; v >= 1; v--) {
+    struct level_s *l = lev + v;
+    if (!l->n) continue;
+    l->out = malloc(sizeof(*l->out) * l->count);
+    for(zdd_id_t j = 0; j < l->count; j++) {
+      struct req_s *q = l->req + l->order[j];
+      uint32_t m = pool_v[q->k0] < pool_v[q->k1] ? pool_v[q->k0] : pool_v[q->k1];
+      l->out[j] = unique(v, m, resolve(q->lo, q->lov), resolve(q->hi, q->hiv));
+      cache_put(OP_INTERSECTION, q->k0, q->k1, l->out[j]);
+    }
+  }
+  root = resolve(root, rootv);
+
+  for(zdd_id_t v = 1; v <= vmax; v++) {
+    free(lev[v].req);
+    free(lev[v].canon);
+    free(lev[v].order);
+    free(lev[v].out);
+  }
+  free(lev);
+  return root;
+}
+
+// Parallel engine: the depth-first recursion, with the HI branch spawned as a
+// task that idle workers may steal, in the style of Lace and Sylvan. Each
+// worker owns a deque; thieves take the oldest task. While a worker waits for
+// a stolen task, it steals back from the thief (leapfrogging), so it only ever
+// runs subproblems of its own.
+//
+// Operand nodes, the unique table and the computed table are read-only until
+// the meld ends. New nodes come from blocks of the pool that each worker
+// carves out for itself, and are listed in ptab, a lock-free hash table.
+// pcache is a lossy table of results guarded by per-slot sequence numbers.
+// If ptab fills up, the meld starts over with a bigger one.
+struct task_s {
+  zdd_id_t k0, k1, r;
+  // 0: queued, 1: stolen, 2: done.
+  int state;
+  int thief;
 };
-typedef struct node_s *node_ptr;
-typedef struct node_s node_t[1];
 
-static node_t pool[1<<24];
-static uint32_t freenode, POOL_MAX = (1<<24) - 1;
-static darray_t stack;
-static uint16_t vmax;
-static char vmax_is_set;
+enum { DEQUE_SIZE = 1 << 16, BLOCK_SIZE = 1 << 12 };
 
-uint16_t zdd_set_vmax(int i) {
-  vmax_is_set = 1;
-  return vmax = i;
+struct worker_s {
+  pthread_t th;
+  int id;
+  char lock;
+  zdd_id_t head, tail;
+  struct task_s *dq;
+  // Unused part of the block of the pool this worker owns.
+  zdd_id_t next, lim;
+  unsigned seed;
+};
+
+struct pcache_entry_s {
+  uint32_t seq;
+  zdd_id_t k0, k1, r;
+};
+
+static uint64_t *ptab;
+static zdd_id_t ptab_mask, ptab_count;
+static struct pcache_entry_s *pcache;
+static zdd_id_t pcache_mask;
+static zdd_id_t par_free;
+// The pairs to meld, two roots each, and where their results go.
+static const zdd_id_t *par_z;
+static zdd_id_t *par_r;
+static int par_n;
+static int par_overflow, par_done, par_active, par_gen;
+// Tells the workers to exit when they next wake.
+static char par_quit;
+static pthread_mutex_t par_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t par_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t par_end = PTHREAD_COND_INITIALIZER;
+
+static void deque_lock(struct worker_s *w) {
+  while (__atomic_test_and_set(&w->lock, __ATOMIC_ACQUIRE)) sched_yield();
 }
 
-void vmax_check() {
-  if (!vmax_is_set) die("vmax not set");
+static void deque_unlock(struct worker_s *w) {
+  __atomic_clear(&w->lock, __ATOMIC_RELEASE);
 }
 
-void zdd_push() { darray_append(stack, (void *) freenode); }
-void zdd_pop() {
-  darray_remove_last(stack);
-  freenode = darray_is_empty(stack) ? 2 : (uint32_t) darray_last(stack);
+static int pcache_get(zdd_id_t *r, zdd_id_t k0, zdd_id_t k1) {
+  struct pcache_entry_s *e = pcache + (ttab_hash(k0, k1) & pcache_mask);
+  uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+  if (!seq || (seq & 1)) return 0;
+  zdd_id_t a = __atomic_load_n(&e->k0, __ATOMIC_RELAXED);
+  zdd_id_t b = __atomic_load_n(&e->k1, __ATOMIC_RELAXED);
+  zdd_id_t x = __atomic_load_n(&e->r, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq) return 0;
+  if (a != k0 || b != k1) return 0;
+  *r = x;
+  return 1;
+}
+
+static void pcache_put(zdd_id_t k0, zdd_id_t k1, zdd_id_t r) {
+  struct pcache_entry_s *e = pcache + (ttab_hash(k0, k1) & pcache_mask);
+  uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+  // Someone else is writing: forget it, the table is lossy anyway.
+  if ((seq & 1) || !__atomic_compare_exchange_n(&e->seq, &seq, seq + 1, 0,
+      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;
+  __atomic_store_n(&e->k0, k0, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->k1, k1, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->r, r, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->seq, seq + 2, __ATOMIC_RELEASE);
 }
 
-void set_node(uint32_t n, uint16_t v, uint32_t lo, uint32_t hi) {
-  pool[n]->v = v;
-  pool[n]->lo = lo;
-  pool[n]->hi = hi;
+// Concurrent counterpart of unique().
+static zdd_id_t par_unique(struct worker_s *w, uint32_t t, uint32_t v,
+                           zdd_id_t lo, zdd_id_t hi) {
+  if (chain_norm(t, &v, &lo, &hi)) return lo;
+  if (cbit && has_empty(lo)) return neg(par_unique(w, t, v, neg(lo), hi));
+  zdd_id_t n = utab_lookup(t, v, lo, hi);
+  if (n) return n;
+  if (w->next == w->lim) {
+    w->next = __atomic_fetch_add(&par_free, BLOCK_SIZE, __ATOMIC_RELAXED);
+    if (w->next > pool_max - BLOCK_SIZE) die("pool is full");
+    w->lim = w->next + BLOCK_SIZE;
+    pool_need(w->lim - 1);
+  }
+  n = w->next;
+  set_node(n, t, v, lo, hi);
+  zdd_id_t h = utab_hash(t, v, lo, hi);
+  uint64_t mine = entry(h, n);
+  for(zdd_id_t i = h & ptab_mask;; i = (i + 1) & ptab_mask) {
+    uint64_t e = __atomic_load_n(ptab + i, __ATOMIC_ACQUIRE);
+    if (!e) {
+      if (!__atomic_compare_exchange_n(ptab + i, &e, mine, 0,
+	  __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+	// Lost the race for this slot: e now holds the winner.
+      } else {
+	w->next++;
+	if (2 * __atomic_add_fetch(&ptab_count, 1, __ATOMIC_RELAXED) > ptab_mask) {
+	  __atomic_store_n(&par_overflow, 1, __ATOMIC_RELAXED);
+	}
+	return n;
+      }
+    }
+    if (!entry_has(e, h)) continue;
+    zdd_id_t m = entry_node(e);
+    if (node_is(m, t, v, lo, hi)) return m;
+  }
+}
+
+static zdd_id_t par_meld(struct worker_s *w, zdd_id_t k0, zdd_id_t k1);
+
+static void spawn(struct worker_s *w, zdd_id_t k0, zdd_id_t k1) {
+  if (w->tail == DEQUE_SIZE) die("deque overflow");
+  deque_lock(w);
+  struct task_s *t = w->dq + w->tail;
+  t->k0 = k0;
+  t->k1 = k1;
+  t->state = 0;
+  w->tail++;
+  deque_unlock(w);
 }
 
-uint32_t zdd_v(uint32_t n) { return pool[n]->v; }
-uint32_t zdd_hi(uint32_t n) { return pool[n]->hi; }
-uint32_t zdd_lo(uint32_t n) { return pool[n]->lo; }
-uint32_t zdd_set_lo(uint32_t n, uint32_t lo) { return pool[n]->lo = lo; }
-uint32_t zdd_set_hi(uint32_t n, uint32_t hi) { return pool[n]->hi = hi; }
-uint32_t zdd_set_hilo(uint32_t n, uint32_t hilo) {
-  return pool[n]->lo = pool[n]->hi = hilo;
+// Runs the oldest queued task of victim, if any.
+static int steal(struct worker_s *w, struct worker_s *victim) {
+  if (__atomic_load_n(&victim->head, __ATOMIC_RELAXED) ==
+      __atomic_load_n(&victim->tail, __ATOMIC_RELAXED)) return 0;
+  deque_lock(victim);
+  struct task_s *t = victim->dq + victim->head;
+  if (victim->head == victim->tail || t->state) {
+    deque_unlock(victim);
+    return 0;
+  }
+  t->thief = w->id;
+  __atomic_store_n(&t->state, 1, __ATOMIC_RELAXED);
+  victim->head++;
+  deque_unlock(victim);
+  t->r = par_meld(w, t->k0, t->k1);
+  __atomic_store_n(&t->state, 2, __ATOMIC_RELEASE);
+  return 1;
 }
-uint32_t zdd_next_node() { return freenode; }
-uint32_t zdd_last_node() { return freenode - 1; }
 
-static void pool_swap(uint32_t x, uint32_t y) {
-  struct node_s tmp = *pool[y];
-  *pool[y] = *pool[x];
-  *pool[x] = tmp;
-  for(uint32_t i = 2; i < freenode; i++) {
-    if (pool[i]->lo == x) pool[i]->lo = y;
-    else if (pool[i]->lo == y) pool[i]->lo = x;
-    if (pool[i]->hi == x) pool[i]->hi = y;
-    else if (pool[i]->hi == y) pool[i]->hi = y;
+// Returns the result of the last task w spawned.
+static zdd_id_t sync_task(struct worker_s *w) {
+  deque_lock(w);
+  struct task_s *t = w->dq + w->tail - 1;
+  if (!t->state) {
+    w->tail--;
+    if (w->head > w->tail) w->head = w->tail;
+    deque_unlock(w);
+    return par_meld(w, t->k0, t->k1);
+  }
+  deque_unlock(w);
+  while (2 != __atomic_load_n(&t->state, __ATOMIC_ACQUIRE)) {
+    if (!steal(w, workers + t->thief)) sched_yield();
   }
+  deque_lock(w);
+  w->tail--;
+  if (w->head > w->tail) w->head = w->tail;
+  deque_unlock(w);
+  return t->r;
 }
 
-uint32_t zdd_root() { return (uint32_t) darray_last(stack); }
-uint32_t zdd_set_root(uint32_t root) {
-  uint32_t i = zdd_root();
-  if (i != root) pool_swap(i, root);
-  return i;
+static zdd_id_t par_meld(struct worker_s *w, zdd_id_t k0, zdd_id_t k1) {
+  zdd_id_t r;
+  if (meld_pair(&k0, &k1, &r)) return r;
+  int tag = r;
+  if (__atomic_load_n(&par_overflow, __ATOMIC_RELAXED)) return 0;
+  if (cache_get(&r, OP_INTERSECTION, k0, k1) || pcache_get(&r, k0, k1)) {
+    return tag ? neg(r) : r;
+  }
+  uint32_t s, m;
+  zdd_id_t c[4], lo, hi;
+  meld_split(k0, k1, &s, &m, c);
+  if (c[0] == c[2] && c[1] == c[3]) {
+    // Both sides ignore this variable, so HI is the same as LO.
+    lo = hi = par_meld(w, c[0], c[1]);
+  } else if (w->tail == DEQUE_SIZE) {
+    // Deeper than the deque holds: keep the HI side for ourselves. Only
+    // this worker moves its tail, so the read needs no lock.
+    lo = par_meld(w, c[0], c[1]);
+    hi = par_meld(w, c[2], c[3]);
+  } else {
+    spawn(w, c[2], c[3]);
+    lo = par_meld(w, c[0], c[1]);
+    hi = sync_task(w);
+  }
+  r = par_unique(w, s, m, lo, hi);
+  pcache_put(k0, k1, r);
+  return tag ? neg(r) : r;
 }
 
-void zdd_count(mpz_ptr z) {
-  uint32_t r = zdd_root(), s = zdd_size();
-  mpz_ptr *count = malloc(sizeof(*count) * s);
-  for(int i = 0; i < s; i++) count[i] = NULL;
-  // Count elements in ZDD rooted at node n.
-  mpz_ptr get_count(uint32_t n) {
-    if (count[n]) return count[n];
-    count[n] = malloc(sizeof(mpz_t));
-    mpz_init(count[n]);
-    if (n <= 1) {
-      mpz_set_ui(count[n], n);
-      return count[n];
-    }
-    uint32_t x = pool[n]->lo;
-    uint32_t y = pool[n]->hi;
-    x = 1 >= x ? x : x - r + 2;
-    y = 1 >= y ? y : y - r + 2;
-    mpz_add(count[n], get_count(x), get_count(y));
-    return count[n];
-  }
-  r = 1 >= r ? r : 2;
-  mpz_set(z, get_count(r));
-  for(int i = 0; i < s; i++) {
-    if (count[i]) {
-      mpz_clear(count[i]);
-      free(count[i]);
+static void *worker_main(void *arg) {
+  struct worker_s *w = arg;
+  int gen = 0;
+  for(;;) {
+    pthread_mutex_lock(&par_mu);
+    while (gen == par_gen) pthread_cond_wait(&par_start, &par_mu);
+    gen = par_gen;
+    pthread_mutex_unlock(&par_mu);
+    if (par_quit) return NULL;
+    if (!w->id) {
+      // Pairs are independent, so all but one are spawned as tasks.
+      for(int k = 0; k < par_n - 1; k++) spawn(w, par_z[2 * k], par_z[2 * k + 1]);
+      int k = par_n - 1;
+      par_r[k] = par_meld(w, par_z[2 * k], par_z[2 * k + 1]);
+      while (k--) par_r[k] = sync_task(w);
+      __atomic_store_n(&par_done, 1, __ATOMIC_RELEASE);
+    } else {
+      while (!__atomic_load_n(&par_done, __ATOMIC_ACQUIRE)) {
+	if (!steal(w, workers + rand_r(&w->seed) % nthreads)) sched_yield();
+      }
     }
+    pthread_mutex_lock(&par_mu);
+    if (!--par_active) pthread_cond_signal(&par_end);
+    pthread_mutex_unlock(&par_mu);
   }
+  return NULL;
 }
 
-void zdd_count_1(restrict mpz_ptr z0, restrict mpz_ptr z1) {
-  uint32_t r = zdd_root(), s = zdd_size();
-  restrict mpz_ptr *count = malloc(sizeof(*count) * s);
-  restrict mpz_ptr *total = malloc(sizeof(*total) * s);
-  for(int i = 0; i < s; i++) count[i] = NULL;
-  // Count elements in ZDD rooted at node n.
-  // Along with total size of solutions.
-  mpz_ptr get_count(uint32_t n) {
-    if (count[n]) return count[n];
-    count[n] = malloc(sizeof(mpz_t));
-    mpz_init(count[n]);
-    total[n] = malloc(sizeof(mpz_t));
-    mpz_init(total[n]);
-    if (n <= 1) {
-      mpz_set_ui(count[n], n);
-      // total[n] should be zero.
-      return count[n];
-    }
-    uint32_t x = pool[n]->lo;
-    uint32_t y = pool[n]->hi;
-    x = 1 >= x ? x : x - r + 2;
-    y = 1 >= y ? y : y - r + 2;
-    mpz_add(count[n], get_count(x), get_count(y));
-    mpz_add(total[n], total[x], total[y]);
-    mpz_add(total[n], total[n], count[y]);
-    return count[n];
-  }
-
-  r = 1 >= r ? r : 2;
-  mpz_set(z0, get_count(r));
-  mpz_set(z1, total[r]);
-  for(int i = 0; i < s; i++) {
-    if (count[i]) {
-      mpz_clear(count[i]);
-      free(count[i]);
-      mpz_clear(total[i]);
-      free(total[i]);
+static void start_workers() {
+  workers = calloc(nthreads, sizeof(*workers));
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  // Recursion depth is bounded by the number of variables, but leapfrogging
+  // can nest several such chains.
+  pthread_attr_setstacksize(&attr, 64 << 20);
+  for(int i = 0; i < nthreads; i++) {
+    struct worker_s *w = workers + i;
+    w->id = i;
+    w->seed = i + 1;
+    w->dq = malloc(sizeof(*w->dq) * DEQUE_SIZE);
+    if (pthread_create(&w->th, &attr, worker_main, w)) {
+      die("pthread_create failed");
     }
   }
+  pthread_attr_destroy(&attr);
 }
 
-// Compute 0, 1, 2 power sums of sizes of sets.
-void zdd_count_2(restrict mpz_ptr z0,
-                 restrict mpz_ptr z1,
-		 restrict mpz_ptr z2) {
-  uint32_t r = zdd_root(), s = zdd_size();
-  restrict mpz_ptr *t0 = malloc(sizeof(*t0) * s);
-  restrict mpz_ptr *t1 = malloc(sizeof(*t1) * s);
-  restrict mpz_ptr *t2 = malloc(sizeof(*t2) * s);
-  for(int i = 0; i < s; i++) t0[i] = NULL;
-  // Count elements in ZDD rooted at node n.
-  // Along with t1 size of solutions.
-  mpz_ptr recurse(uint32_t n) {
-    if (t0[n]) return t0[n];
-    t0[n] = malloc(sizeof(mpz_t));
-    mpz_init(t0[n]);
-    t1[n] = malloc(sizeof(mpz_t));
-    mpz_init(t1[n]);
-    t2[n] = malloc(sizeof(mpz_t));
-    mpz_init(t2[n]);
-    if (n <= 1) {
-      // t0[1] should be 1.
-      mpz_set_ui(t0[n], n);
-      // t1[n], t2[n] should be zero.
-      // Another reason why 0^0 = 1.
-      return t0[n];
-    }
-    uint32_t x = pool[n]->lo;
-    uint32_t y = pool[n]->hi;
-    x = 1 >= x ? x : x - r + 2;
-    y = 1 >= y ? y : y - r + 2;
-    mpz_add(t0[n], recurse(x), recurse(y));
-    mpz_add(t1[n], t1[x], t1[y]);
-    mpz_add(t1[n], t1[n], t0[y]);
-    mpz_add(t2[n], t2[x], t2[y]);
-    mpz_addmul_ui(t2[n], t1[y], 2);
-    mpz_add(t2[n], t2[n], t0[y]);
-    return t0[n];
-  }
-
-  r = 1 >= r ? r : 2;
-  mpz_set(z0, recurse(r));
-  mpz_set(z1, t1[r]);
-  mpz_set(z2, t2[r]);
-  for(int i = 0; i < s; i++) {
-    if (t0[i]) {
-      mpz_clear(t0[i]);
-      free(t0[i]);
-      mpz_clear(t1[i]);
-      free(t1[i]);
-      mpz_clear(t2[i]);
-      free(t2[i]);
-    }
-  }
-}
-
-uint32_t zdd_abs_node(uint32_t v, uint32_t lo, uint32_t hi) {
-  set_node(freenode, v, lo, hi);
-  return freenode++;
+static void stop_workers() {
+  pthread_mutex_lock(&par_mu);
+  par_quit = 1;
+  par_gen++;
+  pthread_cond_broadcast(&par_start);
+  pthread_mutex_unlock(&par_mu);
+  for(int i = 0; i < nthreads; i++) {
+    pthread_join(workers[i].th, NULL);
+    free(workers[i].dq);
+  }
+  free(workers);
+  workers = NULL;
+  // New workers count generations from zero.
+  par_quit = 0;
+  par_gen = 0;
 }
 
-uint32_t zdd_add_node(uint32_t v, int offlo, int offhi) {
-  int n = freenode;
-  uint32_t adjust(int off) {
-    if (!off) return 0;
-    if (-1 == off) return 1;
-    return n + off;
+// Melds the n pairs (z[2k], z[2k + 1]) at once, and puts the roots of their
+// intersections in r. The nodes are left for renumber().
+static void meld_par(const zdd_id_t *z, int n, zdd_id_t *r) {
+  if (!workers) start_workers();
+  zdd_id_t tbase = freenode;
+  // Start from the size the last meld needed.
+  static zdd_id_t size = 1 << 16;
+  for(;;) {
+    ptab = calloc(size, sizeof(*ptab));
+    pcache = calloc(size, sizeof(*pcache));
+    if (!ptab || !pcache) die("out of memory");
+    ptab_mask = pcache_mask = size - 1;
+    ptab_count = 0;
+    par_free = tbase;
+    par_overflow = par_done = 0;
+    for(int i = 0; i < nthreads; i++) {
+      workers[i].head = workers[i].tail = 0;
+      workers[i].next = workers[i].lim = 0;
+    }
+    par_z = z;
+    par_r = r;
+    par_n = n;
+    pthread_mutex_lock(&par_mu);
+    par_active = nthreads;
+    par_gen++;
+    pthread_cond_broadcast(&par_start);
+    while (par_active) pthread_cond_wait(&par_end, &par_mu);
+    pthread_mutex_unlock(&par_mu);
+    if (!par_overflow) break;
+    free(ptab);
+    free(pcache);
+    size <<= 2;
   }
-  set_node(n, v, adjust(offlo), adjust(offhi));
-  return freenode++;
+  freenode = par_free;
+  for(zdd_id_t i = 0; i <= pcache_mask; i++) {
+    struct pcache_entry_s *e = pcache + i;
+    if (e->seq) cache_put(OP_INTERSECTION, e->k0, e->k1, e->r);
+  }
+  free(ptab);
+  free(pcache);
+}
+
+// Collects garbage and reorders when due. Roots on the stack may move.
+static void tidy() {
+  if (freenode >= gc_next) gc();
+  if (reorder_min && freenode >= reorder_next) {
+    gc();
+    if (freenode >= reorder_min) sift();
+    // Look again once the pool grows by as much as is live, or by the
+    // threshold if that is more.
+    reorder_next = freenode + (freenode > reorder_min ? freenode : reorder_min);
+  }
+}
+
+static zdd_id_t meld(zdd_id_t z0, zdd_id_t z1) {
+  if (nthreads > 1) {
+    zdd_id_t z[2] = { z0, z1 }, root;
+    zdd_id_t tbase = freenode;
+    meld_par(z, 1, &root);
+    renumber(tbase, &root, 1);
+    return root;
+  }
+  return ZDD_BFS == engine ? meld_bfs(z0, z1) : meld_dfs(z0, z1);
+}
+
+// The first level the family e may test; sinks come after every level.
+static inline uint32_t top_of(zdd_id_t e) {
+  return idx(e) < 2 ? ~0 : pool_t[idx(e)];
+}
+
+// The sub-families of the family e without and with level m, where no set
+// in it has a variable before m. Chains that free m are cut short, which
+// may take a new node. A tagged edge passes its tag to the LO side.
+static void cofactor(zdd_id_t e, uint32_t m, zdd_id_t *lo, zdd_id_t *hi) {
+  zdd_id_t n = idx(e);
+  if (n < 2 || pool_t[n] > m) {
+    *lo = e;
+    *hi = 0;
+    return;
+  }
+  if (pool_v[n] == m) {
+    *lo = pool_lo[n];
+    *hi = pool_hi[n];
+  } else {
+    *lo = *hi = unique(m + 1, pool_v[n], pool_lo[n], pool_hi[n]);
+  }
+  if (e != n) *lo = neg(*lo);
+}
+
+// Operations on families are computed by one engine, on a stack of its own
+// rather than the C stack, since a ZDD may be as deep as there are
+// variables. An operation either settles at once, from terminal cases or the
+// computed table, or splits its operands on their first level m and follows
+// a plan: a few steps, each applying an operation to two registers and
+// storing the result in a third. The result is then a new node on level m,
+// or one of the registers. Every call a plan makes is on families without
+// level m or any before it, so the stack holds at most vmax + 1 frames.
+
+// Registers of a frame. R_NONE always holds 0, and stands for no operand.
+enum {
+  R_NONE,
+  R_F0, R_F1, R_G0, R_G1,  // Cofactors of the operands f and g by level m.
+  R_F, R_G,  // The operands themselves.
+  R_T0, R_T1, R_T2, R_T3,  // Scratch.
+  NREG
+};
+
+struct step_s {
+  // The operation, or 0 for the frame's own.
+  uint8_t op;
+  uint8_t a, b, dst;
+  // If this register holds 0, so does dst, and the step is skipped.
+  uint8_t guard;
+};
+
+struct plan_s {
+  uint8_t n;
+  struct step_s step[6];
+  // The result is unique(m, m, lo, hi), or lo alone if hi is R_NONE.
+  uint8_t lo, hi;
+};
+
+struct opframe_s {
+  // The operation and the operands it is cached under.
+  zdd_id_t op, f, g;
+  zdd_id_t reg[NREG];
+  const struct plan_s *plan;
+  uint32_t m;
+  // Steps issued so far; the last one's result is pending.
+  uint8_t pc;
+  // Whether the result gets the empty set toggled (1), or added (2).
+  char post;
+};
+
+// Operations recurse on the cofactors by level m: op(f0, g0), op(f1, g1).
+static const struct plan_s plan_split = {
+  2, { { 0, R_F0, R_G0, R_T0 }, { 0, R_F1, R_G1, R_T1 } }, R_T0, R_T1
+};
+
+// Split f and g on level m, into the registers of fr.
+static void split_at(struct opframe_s *fr, zdd_id_t op,
+                     zdd_id_t f, zdd_id_t g, uint32_t m) {
+  fr->op = op;
+  fr->f = f;
+  fr->g = g;
+  fr->m = m;
+  fr->reg[R_NONE] = 0;
+  fr->reg[R_F] = f;
+  fr->reg[R_G] = g;
+  cofactor(f, fr->m, fr->reg + R_F0, fr->reg + R_F1);
+  cofactor(g, fr->m, fr->reg + R_G0, fr->reg + R_G1);
+  fr->pc = 0;
+  fr->post = 0;
+}
+
+// Split f and g on their first level.
+static void split(struct opframe_s *fr, zdd_id_t op, zdd_id_t f, zdd_id_t g) {
+  uint32_t tf = top_of(f), tg = top_of(g);
+  split_at(fr, op, f, g, tf < tg ? tf : tg);
+}
+
+// Union, difference, symmetric difference and intersection, by the textbook
+// recursion on the earlier top level of the operands. Under complement
+// edges, the empty set is set aside as in meld_pair(), so the recursion
+// only sees untagged nodes. Intersection is here for the family algebra
+// below; the stack uses the engines.
+static int setop_enter(struct opframe_s *fr, zdd_id_t op,
+                       zdd_id_t a, zdd_id_t b, zdd_id_t *r) {
+  int tag = 0;
+  if (cbit) {
+    int ea = has_empty(a), eb = has_empty(b);
+    switch (op) {
+      case OP_UNION: tag = ea | eb; break;
+      case OP_DIFFERENCE: tag = ea & !eb; break;
+      case OP_SYMDIFF: tag = ea ^ eb; break;
+      default: tag = ea & eb;
+    }
+    a = 1 == a ? 0 : idx(a);
+    b = 1 == b ? 0 : idx(b);
+  }
+  if (a == b) {
+    *r = OP_UNION == op || OP_INTERSECTION == op ? a : 0;
+  } else if (!a || !b) {
+    if (OP_INTERSECTION == op) *r = 0;
+    else *r = OP_DIFFERENCE == op || a ? a : b;
+  } else {
+    if (OP_DIFFERENCE != op && a > b) *r = a, a = b, b = *r;
+    if (!cache_get(r, op, a, b)) {
+      split(fr, op, a, b);
+      fr->plan = &plan_split;
+      fr->post = tag;
+      return 0;
+    }
+  }
+  if (tag) *r = neg(*r);
+  return 1;
+}
+
+// Knuth's family algebra, TAOCP 7.1.4: the join, meet and delta of f and g
+// pair every set of f with every set of g, and keep their union,
+// intersection and symmetric difference respectively. The quotient f / g
+// holds the sets that every set of g extends, disjointly, to a set of f;
+// by convention f / {} is empty. Also Knuth's nonsub and nonsup: the sets of
+// f that are subsets, or supersets, of no set of g. Edges may be tagged:
+// cofactor() passes the empty set down the LO side, and unique() lifts it
+// back up.
+static const struct plan_s plan_join = { 6, {
+  { 0, R_F0, R_G0, R_T0 },
+  { 0, R_F1, R_G1, R_T1 },
+  { 0, R_F1, R_G0, R_T2 },
+  { OP_UNION, R_T1, R_T2, R_T1 },
+  { 0, R_F0, R_G1, R_T2 },
+  { OP_UNION, R_T1, R_T2, R_T1 },
+}, R_T0, R_T1 };
+
+static const struct plan_s plan_meet = { 6, {
+  { 0, R_F0, R_G0, R_T0 },
+  { 0, R_F1, R_G0, R_T1 },
+  { OP_UNION, R_T0, R_T1, R_T0 },
+  { 0, R_F0, R_G1, R_T1 },
+  { OP_UNION, R_T0, R_T1, R_T0 },
+  { 0, R_F1, R_G1, R_T1 },
+}, R_T0, R_T1 };
+
+static const struct plan_s plan_delta = { 6, {
+  { 0, R_F0, R_G0, R_T0 },
+  { 0, R_F1, R_G1, R_T1 },
+  { OP_UNION, R_T0, R_T1, R_T0 },
+  { 0, R_F1, R_G0, R_T1 },
+  { 0, R_F0, R_G1, R_T2 },
+  { OP_UNION, R_T1, R_T2, R_T1 },
+}, R_T0, R_T1 };
+
+// Only sets of g with m can hold a set of f with m.
+static const struct plan_s plan_nonsub = { 3, {
+  { OP_UNION, R_G0, R_G1, R_T0 },
+  { 0, R_F0, R_T0, R_T0 },
+  { 0, R_F1, R_G1, R_T1 },
+}, R_T0, R_T1 };
+
+// Only sets of f with m can hold a set of g with m.
+static const struct plan_s plan_nonsup = { 3, {
+  { 0, R_F0, R_G0, R_T0 },
+  { OP_UNION, R_G0, R_G1, R_T1 },
+  { 0, R_F1, R_T1, R_T1 },
+}, R_T0, R_T1 };
+
+// Sets of g without level m leave it free in the quotient; sets with it
+// must find it in f, and it is gone from the quotient.
+static const struct plan_s plan_quotient_free = { 2, {
+  { 0, R_F0, R_G, R_T0 },
+  { 0, R_F1, R_G, R_T1 },
+}, R_T0, R_T1 };
+
+static const struct plan_s plan_quotient_hi = { 1, {
+  { 0, R_F1, R_G1, R_T0 },
+}, R_T0, R_NONE };
+
+static const struct plan_s plan_quotient = { 3, {
+  { 0, R_F1, R_G1, R_T0 },
+  { 0, R_F0, R_G0, R_T1, R_T0 },
+  { OP_INTERSECTION, R_T0, R_T1, R_T0 },
+}, R_T0, R_NONE };
+
+static int algebra_enter(struct opframe_s *fr, zdd_id_t op,
+                         zdd_id_t f, zdd_id_t g, zdd_id_t *r) {
+  *r = 0;
+  if (!f) return 1;
+  if (!g) {
+    if (OP_NONSUB == op || OP_NONSUP == op) *r = f;
+    return 1;
+  }
+  switch (op) {
+    case OP_JOIN:
+    case OP_DELTA:
+      if (1 == f) return *r = g, 1;
+      if (1 == g) return *r = f, 1;
+      break;
+    case OP_MEET:
+      if (1 == f || 1 == g) return *r = 1, 1;
+      break;
+    case OP_QUOTIENT:
+      if (1 == g) return *r = f, 1;
+      if (f == g) return *r = 1, 1;
+      break;
+    case OP_NONSUB:
+      // The empty set is a subset of anything.
+      if (f == g || 1 == f) return 1;
+      break;
+    case OP_NONSUP:
+      if (f == g || 1 == g) return 1;
+      break;
+  }
+  int symmetric = OP_JOIN == op || OP_MEET == op || OP_DELTA == op;
+  if (symmetric && f > g) *r = f, f = g, g = *r;
+  if (cache_get(r, op, f, g)) return 1;
+  split(fr, op, f, g);
+  switch (op) {
+    case OP_JOIN: fr->plan = &plan_join; break;
+    case OP_MEET: fr->plan = &plan_meet; break;
+    case OP_DELTA: fr->plan = &plan_delta; break;
+    case OP_NONSUB: fr->plan = &plan_nonsub; break;
+    case OP_NONSUP: fr->plan = &plan_nonsup; break;
+    default:
+      if (!fr->reg[R_G1]) fr->plan = &plan_quotient_free;
+      else if (!fr->reg[R_G0]) fr->plan = &plan_quotient_hi;
+      else fr->plan = &plan_quotient;
+  }
+  return 0;
+}
+
+// The maximal or minimal sets of f, those no other set of f contains or is
+// contained in. A set without the top level is maximal if it is maximal among
+// those sets and below no set with the top level; dually for minimal. The
+// second operand is unused, and 0.
+static const struct plan_s plan_maximal = { 3, {
+  { 0, R_F0, R_NONE, R_T0 },
+  { 0, R_F1, R_NONE, R_T1 },
+  { OP_NONSUB, R_T0, R_F1, R_T0 },
+}, R_T0, R_T1 };
+
+static const struct plan_s plan_minimal = { 3, {
+  { 0, R_F0, R_NONE, R_T0 },
+  { 0, R_F1, R_NONE, R_T1 },
+  { OP_NONSUP, R_T1, R_F0, R_T1 },
+}, R_T0, R_T1 };
+
+static int extremal_enter(struct opframe_s *fr, zdd_id_t op,
+                          zdd_id_t f, zdd_id_t *r) {
+  if (idx(f) < 2) return *r = f, 1;
+  if (cache_get(r, op, f, 0)) return 1;
+  split(fr, op, f, 0);
+  fr->plan = OP_MAXIMAL == op ? &plan_maximal : &plan_minimal;
+  return 0;
+}
+
+// Minato's onset, offset and change of f by the variable at the level s
+// tests, where s is the node of the family {{v}}: the sets with v, less v;
+// the sets without v; and every set with v toggled. Keying the computed
+// table on s rather than the level keeps entries valid through collections
+// and reordering. The empty set never holds v, so onset and offset set its
+// tag aside. Only f is split; levels before v keep their node.
+static const struct plan_s plan_restrict = { 2, {
+  { 0, R_F0, R_G, R_T0 },
+  { 0, R_F1, R_G, R_T1 },
+}, R_T0, R_T1 };
+
+static int restrict_enter(struct opframe_s *fr, zdd_id_t op,
+                          zdd_id_t f, zdd_id_t s, zdd_id_t *r) {
+  uint32_t l = pool_v[s];
+  int tag = 0;
+  if (cbit && OP_CHANGE != op) {
+    tag = OP_OFFSET == op && has_empty(f);
+    f = 1 == f ? 0 : idx(f);
+  }
+  uint32_t m = top_of(f);
+  if (m > l) {
+    // No set of f has v.
+    if (OP_ONSET == op) *r = 0;
+    else *r = OP_OFFSET == op ? f : unique(l, l, 0, f);
+  } else if (!cache_get(r, op, f, s)) {
+    split(fr, op, f, s);
+    if (m < l) {
+      fr->plan = &plan_restrict;
+      fr->post = tag;
+      return 0;
+    }
+    zdd_id_t f0 = fr->reg[R_F0], f1 = fr->reg[R_F1];
+    if (OP_ONSET == op) *r = f1;
+    else *r = OP_OFFSET == op ? f0 : unique(l, l, f1, f0);
+    cache_put(op, f, s, *r);
+  }
+  if (tag) *r = neg(*r);
+  return 1;
+}
+
+// The restriction of every set of f to the levels of the one set in c,
+// duplicates merged. Keying the computed table on c, a canonical node, lets
+// entries outlive the call, as in restrict_enter(). Dropped levels fold into
+// a union. Under complement edges the empty set projects to itself.
+static const struct plan_s plan_project_keep = { 2, {
+  { 0, R_F0, R_G1, R_T0 },
+  { 0, R_F1, R_G1, R_T1 },
+}, R_T0, R_T1 };
+
+static const struct plan_s plan_project_drop = { 3, {
+  { 0, R_F0, R_G, R_T0 },
+  { 0, R_F1, R_G, R_T1 },
+  { OP_UNION, R_T0, R_T1, R_T0 },
+}, R_T0, R_NONE };
+
+static int project_enter(struct opframe_s *fr,
+                         zdd_id_t f, zdd_id_t c, zdd_id_t *r) {
+  if (!f) return *r = 0, 1;
+  if (1 == c || idx(f) < 2) return *r = 1, 1;
+  int tag = 0;
+  if (cbit) {
+    tag = has_empty(f);
+    f = idx(f);
+  }
+  // Kept levels before the top of f are in no set.
+  uint32_t m = top_of(f);
+  while (top_of(c) < m) c = pool_hi[c];
+  if (1 == c) {
+    *r = 1;
+  } else if (!cache_get(r, OP_PROJECT, f, c)) {
+    // Free levels of a chain before the next kept level are dropped, which
+    // leaves the same family, so cut the chain there or at the level it
+    // tests.
+    m = top_of(c) < pool_v[f] ? top_of(c) : pool_v[f];
+    split_at(fr, OP_PROJECT, f, c, m);
+    fr->plan = top_of(c) == m ? &plan_project_keep : &plan_project_drop;
+    fr->post = 2 * tag;
+    return 0;
+  }
+  if (tag && !has_empty(*r)) *r = neg(*r);
+  return 1;
+}
+
+// Starts op on f and g in the frame fr. Returns 1 if it settles at once,
+// with the result in *r.
+static int enter(struct opframe_s *fr, zdd_id_t op,
+                 zdd_id_t f, zdd_id_t g, zdd_id_t *r) {
+  switch (op) {
+    case OP_UNION:
+    case OP_DIFFERENCE:
+    case OP_SYMDIFF:
+    case OP_INTERSECTION:
+      return setop_enter(fr, op, f, g, r);
+    case OP_MAXIMAL:
+    case OP_MINIMAL:
+      return extremal_enter(fr, op, f, r);
+    case OP_ONSET:
+    case OP_OFFSET:
+    case OP_CHANGE:
+      return restrict_enter(fr, op, f, g, r);
+    case OP_PROJECT:
+      return project_enter(fr, f, g, r);
+  }
+  return algebra_enter(fr, op, f, g, r);
+}
+
+// Finishes the frame fr, whose plan has run, and returns its result.
+static zdd_id_t leave(struct opframe_s *fr) {
+  const struct plan_s *p = fr->plan;
+  zdd_id_t r = fr->reg[p->lo];
+  if (R_NONE != p->hi) r = unique(fr->m, fr->m, r, fr->reg[p->hi]);
+  cache_put(fr->op, fr->f, fr->g, r);
+  if (1 == fr->post) return neg(r);
+  if (2 == fr->post && !has_empty(r)) return neg(r);
+  return r;
+}
+
+static zdd_id_t apply(zdd_id_t op, zdd_id_t f, zdd_id_t g) {
+  struct opframe_s *stk = NULL;
+  int sp = -1, cap = 0;
+  zdd_id_t r;
+  for(;;) {
+    // Make the pending call, op on f and g.
+    if (sp + 1 == cap) {
+      cap = cap ? 2 * cap : 64;
+      stk = realloc(stk, sizeof(*stk) * cap);
+      if (!stk) die("out of memory");
+    }
+    if (!enter(stk + sp + 1, op, f, g, &r)) sp++;
+    // Hand r to the frame that asked, unless that frame is new, and run
+    // frames until one makes a call or none are left.
+    for(;; sp--) {
+      if (sp < 0) {
+	free(stk);
+	return r;
+      }
+      struct opframe_s *fr = stk + sp;
+      const struct plan_s *p = fr->plan;
+      if (fr->pc) fr->reg[p->step[fr->pc - 1].dst] = r;
+      int call = 0;
+      while (!call && fr->pc < p->n) {
+	const struct step_s *s = p->step + fr->pc++;
+	if (s->guard && !fr->reg[s->guard]) {
+	  fr->reg[s->dst] = 0;
+	  continue;
+	}
+	op = s->op ? s->op : fr->op;
+	f = fr->reg[s->a];
+	g = fr->reg[s->b];
+	call = 1;
+      }
+      if (call) break;
+      r = leave(fr);
+    }
+  }
+}
+
+// Replaces the top two ZDDs with the result of op on them.
+static zdd_id_t stack_op(zdd_id_t op) {
+  vmax_check();
+  if (darray_count(stack) == 0) return 0;
+  seal();
+  if (darray_count(stack) == 1) {
+    return (zdd_id_t) (uintptr_t) darray_last(stack);
+  }
+  tidy();
+  zdd_id_t z0 =
+      (zdd_id_t) (uintptr_t) darray_at(stack, darray_count(stack) - 2);
+  zdd_id_t z1 = (zdd_id_t) (uintptr_t) darray_remove_last(stack);
+  zdd_id_t r;
+  switch (op) {
+    case OP_INTERSECTION:
+      r = meld(z0, z1);
+      break;
+    case OP_UNION:
+    case OP_DIFFERENCE:
+    case OP_SYMDIFF:
+      r = apply(op, z0, z1);
+      break;
+    case OP_REMAINDER:
+      // f mod g = f - g join (f / g).
+      r = apply(OP_QUOTIENT, z0, z1);
+      r = apply(OP_DIFFERENCE, z0, apply(OP_JOIN, z1, r));
+      break;
+    case OP_SUBSETS:
+      r = apply(OP_DIFFERENCE, z0, apply(OP_NONSUB, z0, z1));
+      break;
+    case OP_SUPERSETS:
+      r = apply(OP_DIFFERENCE, z0, apply(OP_NONSUP, z0, z1));
+      break;
+    default:
+      r = apply(op, z0, z1);
+  }
+  zdd_set_root(r);
+  return zdd_root();
 }
 
-uint32_t zdd_intersection() {
+zdd_id_t zdd_intersection() { return stack_op(OP_INTERSECTION); }
+zdd_id_t zdd_union() { return stack_op(OP_UNION); }
+zdd_id_t zdd_difference() { return stack_op(OP_DIFFERENCE); }
+zdd_id_t zdd_symdiff() { return stack_op(OP_SYMDIFF); }
+zdd_id_t zdd_join() { return stack_op(OP_JOIN); }
+zdd_id_t zdd_meet() { return stack_op(OP_MEET); }
+zdd_id_t zdd_delta() { return stack_op(OP_DELTA); }
+zdd_id_t zdd_quotient() { return stack_op(OP_QUOTIENT); }
+zdd_id_t zdd_remainder() { return stack_op(OP_REMAINDER); }
+zdd_id_t zdd_nonsub() { return stack_op(OP_NONSUB); }
+zdd_id_t zdd_nonsup() { return stack_op(OP_NONSUP); }
+zdd_id_t zdd_subsets() { return stack_op(OP_SUBSETS); }
+zdd_id_t zdd_supersets() { return stack_op(OP_SUPERSETS); }
+
+// Replaces the top ZDD with the result of op on it.
+static zdd_id_t stack_op1(zdd_id_t op) {
+  vmax_check();
+  if (darray_count(stack) == 0) return 0;
+  seal();
+  tidy();
+  return zdd_set_root(apply(op, zdd_root(), 0));
+}
+
+zdd_id_t zdd_maximal() { return stack_op1(OP_MAXIMAL); }
+zdd_id_t zdd_minimal() { return stack_op1(OP_MINIMAL); }
+
+static zdd_id_t stack_var(zdd_id_t op, int v) {
+  vmax_check();
+  if (darray_count(stack) == 0) return 0;
+  if (v < 1 || v > vmax) die("no variable %d", v);
+  seal();
+  tidy();
+  uint32_t l = var_lvl[v];
+  return zdd_set_root(apply(op, zdd_root(), unique(l, l, 0, 1)));
+}
+
+zdd_id_t zdd_onset(int v) { return stack_var(OP_ONSET, v); }
+zdd_id_t zdd_offset(int v) { return stack_var(OP_OFFSET, v); }
+zdd_id_t zdd_change(int v) { return stack_var(OP_CHANGE, v); }
+
+zdd_id_t zdd_assign(const int *lit, int count) {
   vmax_check();
   if (darray_count(stack) == 0) return 0;
-  if (darray_count(stack) == 1) return (uint32_t) darray_last(stack);
-  uint32_t z0 = (uint32_t) darray_at(stack, darray_count(stack) - 2);
-  uint32_t z1 = (uint32_t) darray_remove_last(stack);
-  struct node_template_s {
-    uint16_t v;
-    // NULL means this template have been instantiated.
-    // Otherwise it points to the LO template.
-    memo_it lo;
-    union {
-      // Points to HI template when template is not yet instantiated.
-      memo_it hi;
-      // During template instantiation we set n to the pool index
-      // of the newly created node.
-      uint32_t n;
-    };
-  };
-  typedef struct node_template_s *node_template_ptr;
-  typedef struct node_template_s node_template_t[1];
-
-  node_template_t top, bot;
-  bot->v = 0;
-  bot->lo = NULL;
-  bot->n = 0;
-  top->v = 1;
-  top->lo = NULL;
-  top->n = 1;
-
-  // Naive implementation with two tries. One stores templates, the other
-  // unique nodes. See Knuth for how to meld using just memory allocated
-  // for a pool of nodes.
-  memo_t tab;
-  memo_init(tab);
-
-  memo_it insert_template(uint32_t k0, uint32_t k1) {
-    uint32_t key[2];
-    // Taking advantage of symmetry of intersection appears to help a tiny bit.
-    if (k0 < k1) {
-      key[0] = k0;
-      key[1] = k1;
+  seal();
+  tidy();
+  // Sort the literals by level, as (level, wanted) pairs. Asking for a
+  // variable both ways leaves nothing.
+  uint32_t (*a)[2] = malloc(sizeof(*a) * (count + 1));
+  for(int i = 0; i < count; i++) {
+    int v = lit[i] < 0 ? -lit[i] : lit[i];
+    if (v < 1 || v > vmax) die("no variable %d", v);
+    a[i][0] = var_lvl[v];
+    a[i][1] = lit[i] > 0;
+  }
+  int cmp(const void *p, const void *q) {
+    const uint32_t *x = p, *y = q;
+    return x[0] != y[0] ? (x[0] < y[0] ? -1 : 1) : (int) x[1] - (int) y[1];
+  }
+  qsort(a, count, sizeof(*a), cmp);
+  int n = 0;
+  zdd_id_t r = zdd_root();
+  for(int i = 0; i < count; i++) {
+    if (n && a[n - 1][0] == a[i][0]) {
+      if (a[n - 1][1] != a[i][1]) r = 0;
+      continue;
+    }
+    a[n][0] = a[i][0];
+    a[n][1] = a[i][1];
+    n++;
+  }
+  // Walk f and the literals from the i-th on together, depth-first on an
+  // explicit stack, since f may be as deep as there are variables. The
+  // template table is free between melds, and serves as the memo.
+  struct frame_s {
+    // The memo key.
+    zdd_id_t f;
+    int i;
+    uint32_t m;
+    // Calls on arg[0], then arg[1] if n is 2, with the literals from the
+    // j-th on. Two results make a node on level m.
+    zdd_id_t arg[2], res[2];
+    int j;
+    uint8_t n, pc;
+  } *stk = NULL;
+  int sp = -1, cap = 0;
+  // Returns 1 if f and the literals from the i-th on settle at once, with
+  // the result in *res; otherwise pushes a frame for them.
+  int start(zdd_id_t f, int i, zdd_id_t *res) {
+    uint32_t l, m;
+    for(;; i++) {
+      if (i == n || !f) return *res = f, 1;
+      l = a[i][0];
+      m = top_of(f);
+      if (m <= l) break;
+      if (a[i][1]) return *res = 0, 1;
+    }
+    ttab_entry_ptr e = ttab_at(f, i);
+    if (NIL != e->t) return *res = e->t, 1;
+    if (sp + 1 == cap) {
+      cap = cap ? 2 * cap : 64;
+      stk = realloc(stk, sizeof(*stk) * cap);
+      if (!stk) die("out of memory");
+    }
+    struct frame_s *fr = stk + ++sp;
+    fr->f = f;
+    fr->i = i;
+    fr->m = m;
+    fr->pc = 0;
+    zdd_id_t f0, f1;
+    cofactor(f, m, &f0, &f1);
+    if (m < l) {
+      fr->n = 2, fr->j = i;
+      fr->arg[0] = f0, fr->arg[1] = f1;
+    } else if (a[i][1]) {
+      fr->n = 2, fr->j = i + 1;
+      fr->arg[0] = 0, fr->arg[1] = f1;
     } else {
-      key[0] = k1;
-      key[1] = k0;
+      fr->n = 1, fr->j = i + 1;
+      fr->arg[0] = f0;
     }
-    memo_it it;
-    int just_created = memo_it_insert_u(&it, tab, (void *) key, 8);
-    if (!just_created) return it;
-    if (!k0 || !k1) {
-      memo_it_put(it, bot);
-      return it;
-    }
-    if (k0 == 1 && k1 == 1) {
-      memo_it_put(it, top);
-      return it;
-    }
-    node_ptr n0 = pool[k0];
-    node_ptr n1 = pool[k1];
-    if (n0->v == n1->v) {
-      node_template_ptr t = malloc(sizeof(*t));
-      t->v = n0->v;
-      if (n0->lo == n0->hi && n1->lo == n0->hi) {
-	t->lo = t->hi = insert_template(n0->lo, n1->lo);
-      } else {
-	t->lo = insert_template(n0->lo, n1->lo);
-	t->hi = insert_template(n0->hi, n1->hi);
+    return 0;
+  }
+  zdd_id_t walk(zdd_id_t f) {
+    int i = 0;
+    zdd_id_t r = 0;
+    for(;;) {
+      start(f, i, &r);
+      // Hand r to the frame that asked, unless that frame is new, and run
+      // frames until one makes a call or none are left.
+      for(;; sp--) {
+	if (sp < 0) return r;
+	struct frame_s *fr = stk + sp;
+	if (fr->pc) fr->res[fr->pc - 1] = r;
+	if (fr->pc < fr->n) {
+	  f = fr->arg[fr->pc++];
+	  i = fr->j;
+	  break;
+	}
+	r = 2 == fr->n ? unique(fr->m, fr->m, fr->res[0], fr->res[1])
+		       : fr->res[0];
+	// The table may have grown under us.
+	ttab_at(fr->f, fr->i)->t = r;
       }
-      memo_it_put(it, t);
-      return it;
-    } else if (n0->v < n1->v) {
-      memo_it it2 = insert_template(n0->lo, k1);
-      memo_it_put(it, memo_it_data(it2));
-      return it2;
-    } else {
-      memo_it it2 = insert_template(k0, n1->lo);
-      memo_it_put(it, memo_it_data(it2));
-      return it2;
     }
   }
+  ttab_reset();
+  if (r) r = walk(r);
+  free(stk);
+  free(a);
+  return zdd_set_root(r);
+}
+
+zdd_id_t zdd_project(const int *a, int count) {
+  vmax_check();
+  if (darray_count(stack) == 0) return 0;
+  seal();
+  tidy();
+  uint32_t *l = malloc(sizeof(*l) * (count + 1));
+  for(int i = 0; i < count; i++) {
+    if (a[i] < 1 || a[i] > vmax) die("no variable %d", a[i]);
+    l[i] = var_lvl[a[i]];
+  }
+  int cmp(const void *p, const void *q) {
+    uint32_t x = *(const uint32_t *) p, y = *(const uint32_t *) q;
+    return x < y ? -1 : x > y;
+  }
+  qsort(l, count, sizeof(*l), cmp);
+  // Build {{a[0], ..., a[count - 1]}} from the bottom up.
+  zdd_id_t c = 1;
+  for(int i = count - 1; i >= 0; i--) {
+    if (i + 1 < count && l[i] == l[i + 1]) continue;
+    c = unique(l[i], l[i], 0, c);
+  }
+  free(l);
+  return zdd_set_root(apply(OP_PROJECT, zdd_root(), c));
+}
+
+// The operands of one level of the tree stay on the stack, so collections
+// see them; each result overwrites a slot whose operands are spent. On
+// several threads, the pairs of a level meld as one parallel job, up to
+// TREE_BATCH pairs at a time.
+enum { TREE_BATCH = DEQUE_SIZE / 4 };
 
-  void dump(void* data, const char* key) {
-    uint32_t *n = (uint32_t *) key;
-    if (!data) {
-      printf("NULL %d:%d\n", n[0], n[1]);
-      return;
+zdd_id_t zdd_intersect_tree(int count, void (*build)(int)) {
+  vmax_check();
+  if (!count) return zdd_powerset();
+  int base = darray_count(stack);
+  for(int i = 0; i < count; i++) build(i);
+  seal();
+  if (darray_count(stack) != base + count) die("builder must push one ZDD");
+  zdd_id_t at(int i) {
+    return (zdd_id_t) (uintptr_t) darray_at(stack, base + i);
+  }
+  void set(int i, zdd_id_t r) {
+    darray_raw(stack)[base + i] = (void *) (uintptr_t) r;
+  }
+  zdd_id_t *z = malloc(sizeof(*z) * 2 * TREE_BATCH);
+  zdd_id_t *r = malloc(sizeof(*r) * TREE_BATCH);
+  while (count > 1) {
+    int pairs = count / 2;
+    for(int k0 = 0; k0 < pairs; k0 += TREE_BATCH) {
+      int n = pairs - k0 < TREE_BATCH ? pairs - k0 : TREE_BATCH;
+      if (nthreads > 1) {
+	tidy();
+	for(int k = 0; k < n; k++) {
+	  z[2 * k] = at(2 * (k0 + k));
+	  z[2 * k + 1] = at(2 * (k0 + k) + 1);
+	}
+	zdd_id_t tbase = freenode;
+	meld_par(z, n, r);
+	renumber(tbase, r, n);
+	for(int k = 0; k < n; k++) set(k0 + k, r[k]);
+      } else {
+	for(int k = k0; k < k0 + n; k++) {
+	  tidy();
+	  set(k, meld(at(2 * k), at(2 * k + 1)));
+	}
+      }
     }
-    node_template_ptr t = (node_template_ptr) data;
-    if (!t->lo)  {
-      printf("%d:%d = (%d)\n", n[0], n[1], t->n);
-      return;
+    // An odd one out waits for the next level.
+    if (count & 1) set(pairs, at(count - 1));
+    count = pairs + (count & 1);
+  }
+  free(z);
+  free(r);
+  while (darray_count(stack) > base + 1) darray_remove_last(stack);
+  return zdd_root();
+}
+
+void zdd_set_schedule_log(int on) { schedule_log = !!on; }
+
+// What the scheduler knows of a ZDD: its node count, and a bitmap of the
+// levels where its nodes branch, that is, have distinct children. Levels
+// that are merely skipped or that chains pass over constrain nothing.
+struct survey_s {
+  zdd_id_t root, size;
+  int id;  // Row of the overlap table.
+  uint64_t *lv;
+};
+
+static void survey(struct survey_s *p, zdd_id_t root, int words) {
+  p->root = root;
+  p->size = 0;
+  memset(p->lv, 0, sizeof(*p->lv) * words);
+  if (idx(root) < 2) return;
+  // Depth-first, with a hash set of the nodes seen.
+  zdd_id_t mask = 63, count = 0;
+  zdd_id_t *seen = calloc(mask + 1, sizeof(*seen));
+  int visit(zdd_id_t n) {
+    zdd_id_t i = n * 0x9e3779b1u & mask;
+    for(; seen[i]; i = (i + 1) & mask) if (seen[i] == n) return 0;
+    seen[i] = n;
+    if (2 * ++count > mask) {
+      zdd_id_t *old = seen, oldmask = mask;
+      mask = 2 * mask + 1;
+      seen = calloc(mask + 1, sizeof(*seen));
+      for(zdd_id_t j = 0; j <= oldmask; j++) {
+	if (!old[j]) continue;
+	zdd_id_t k = old[j] * 0x9e3779b1u & mask;
+	while (seen[k]) k = (k + 1) & mask;
+	seen[k] = old[j];
+      }
+      free(old);
     }
-    uint32_t *l = (uint32_t *) memo_it_key(t->lo);
-    uint32_t *h = (uint32_t *) memo_it_key(t->hi);
-    printf("%d:%d = %d:%d, %d:%d\n", n[0], n[1], l[0], l[1], h[0], h[1]);
+    return 1;
   }
+  // Levels strictly increase down the stack, and each node pushes two.
+  zdd_id_t *stk = malloc(sizeof(*stk) * 2 * (vmax + 2));
+  int sp = 0;
+  stk[sp++] = idx(root);
+  while (sp) {
+    zdd_id_t n = stk[--sp];
+    if (n < 2 || !visit(n)) continue;
+    if (pool_lo[n] != pool_hi[n]) p->lv[pool_v[n] / 64] |= 1ull << pool_v[n] % 64;
+    stk[sp++] = pool_lo[n];
+    stk[sp++] = idx(pool_hi[n]);
+  }
+  p->size = count;
+  free(stk);
+  free(seen);
+}
 
-  memo_t node_tab[vmax + 1];
-  for(uint16_t v = 1; v <= vmax; v++) memo_init(node_tab[v]);
+// Intersects the top count ZDDs greedily. Each step melds the pair whose
+// result promises to be smallest. The estimate is the node count of the
+// smaller of the two, which usually bounds the result, scaled by the average
+// ratio seen so far for pairs whose branching levels overlap about as much.
+// Summing the operands instead favours pairs of unrelated small constraints,
+// whose products swell every later meld.
+enum { OVERLAP_BUCKETS = 4 };
 
-  uint32_t unique(uint16_t v, uint32_t lo, uint32_t hi) {
-    // Create or return existing node representing !v ? lo : hi.
-    uint32_t key[2] = { lo, hi };
-    memo_it it;
-    int just_created = memo_it_insert_u(&it, node_tab[v], (void *) key, 8);
-    if (just_created) {
-      memo_it_put(it, (void *) freenode);
-      node_ptr n = pool[freenode];
-      n->v = v;
-      n->lo = lo;
-      n->hi = hi;
-      if (!(freenode << 15)) printf("freenode = %x\n", freenode);
-      if (POOL_MAX == freenode) {
-	die("pool is full");
+zdd_id_t zdd_intersect_all(int count) {
+  vmax_check();
+  seal();
+  if (!count) return zdd_powerset();
+  int base = darray_count(stack) - count;
+  if (base < 0) die("stack holds fewer than %d ZDDs", count);
+  zdd_id_t at(int i) {
+    return (zdd_id_t) (uintptr_t) darray_at(stack, base + i);
+  }
+  void set(int i, zdd_id_t r) {
+    darray_raw(stack)[base + i] = (void *) (uintptr_t) r;
+  }
+  int words = vmax / 64 + 1, cap = count;
+  struct survey_s *sv = malloc(sizeof(*sv) * count);
+  uint64_t *lv = malloc(sizeof(*lv) * words * cap);
+  // Overlap of the branching levels of each pair of rows, as the size of
+  // their intersection over the size of their union.
+  float *ov = malloc(sizeof(*ov) * cap * cap);
+  void fill(int i) {
+    for(int j = 0; j < count; j++) {
+      int n = 0, u = 0;
+      for(int w = 0; w < words; w++) {
+	n += __builtin_popcountll(sv[i].lv[w] & sv[j].lv[w]);
+	u += __builtin_popcountll(sv[i].lv[w] | sv[j].lv[w]);
+      }
+      ov[sv[i].id * cap + sv[j].id] = ov[sv[j].id * cap + sv[i].id] =
+	  u ? (float) n / u : 1;
+    }
+  }
+  void survey_all() {
+    for(int i = 0; i < count; i++) survey(sv + i, at(i), words);
+    for(int i = 0; i < count; i++) fill(i);
+  }
+  for(int i = 0; i < count; i++) {
+    sv[i].id = i;
+    sv[i].lv = lv + i * words;
+  }
+  survey_all();
+  // Ratios of result size to smaller operand size, summed per overlap
+  // bucket, starting from one guess each: 1 for disjoint levels, falling
+  // to 1/2 for the same levels.
+  double ratio[OVERLAP_BUCKETS];
+  int seen[OVERLAP_BUCKETS];
+  for(int k = 0; k < OVERLAP_BUCKETS; k++) {
+    ratio[k] = 1 - (k + 0.5) / (2 * OVERLAP_BUCKETS);
+    seen[k] = 1;
+  }
+  int bucket(double x) {
+    int k = x * OVERLAP_BUCKETS;
+    return k < OVERLAP_BUCKETS ? k : OVERLAP_BUCKETS - 1;
+  }
+  int step = 0;
+  while (count > 1) {
+    int rc = reorder_count;
+    tidy();
+    // Collections move roots; sifting also changes sizes and levels.
+    if (rc != reorder_count) survey_all();
+    else for(int i = 0; i < count; i++) sv[i].root = at(i);
+    int a = 0, b = 1;
+    double best = -1, best_ov = 0;
+    zdd_id_t best_sum = 0;
+    for(int i = 0; i < count; i++) for(int j = i + 1; j < count; j++) {
+      double x = ov[sv[i].id * cap + sv[j].id];
+      int k = bucket(x);
+      zdd_id_t small = sv[i].size < sv[j].size ? sv[i].size : sv[j].size;
+      zdd_id_t sum = sv[i].size + sv[j].size;
+      double est = small * ratio[k] / seen[k];
+      // On a tie, the cheaper meld, then the closer pair.
+      if (best < 0 || est < best || (est == best &&
+	  (sum < best_sum || (sum == best_sum && x > best_ov)))) {
+	best = est;
+	best_ov = x;
+	best_sum = sum;
+	a = i;
+	b = j;
+      }
+    }
+    zdd_id_t r = meld(sv[a].root, sv[b].root);
+    zdd_id_t sa = sv[a].size, sb = sv[b].size;
+    survey(sv + a, r, words);
+    zdd_id_t small = sa < sb ? sa : sb;
+    int k = bucket(best_ov);
+    if (small) {
+      ratio[k] += (double) sv[a].size / small;
+      seen[k]++;
+    }
+    if (schedule_log) {
+      fprintf(stderr, "schedule %d: %d (%lu nodes) & %d (%lu nodes), "
+	      "overlap %.2f, estimate %.0f, got %lu\n", step, a,
+	      (unsigned long) sa, b, (unsigned long) sb,
+	      best_ov, best, (unsigned long) sv[a].size);
+    }
+    step++;
+    set(a, r);
+    sv[b] = sv[count - 1];
+    set(b, at(count - 1));
+    darray_remove_last(stack);
+    count--;
+    fill(a);
+  }
+  free(ov);
+  free(lv);
+  free(sv);
+  return zdd_root();
+}
+
+// One traversal of all the operands at once, so no intermediate ZDD is ever
+// built. A tuple of operand nodes is prepared as meld_pair() prepares a pair:
+// variables that some operand lacks are skipped, and any FALSE ends the
+// branch. Then duplicates go and the rest are sorted, so each tuple has one
+// key. Pairs are remembered in the computed table, and longer tuples in a
+// hash table of their own, whose keys live in an arena.
+zdd_id_t zdd_intersect_n(int count) {
+  vmax_check();
+  seal();
+  if (!count) return zdd_powerset();
+  int base = darray_count(stack) - count;
+  if (base < 0) die("stack holds fewer than %d ZDDs", count);
+  if (1 == count) return zdd_root();
+  tidy();
+  struct memo_s {
+    size_t key;
+    zdd_id_t r;
+    int n;  // Tuple length; 0 means empty.
+  } *memo;
+  zdd_id_t memo_mask = 1023, memo_count = 0;
+  memo = calloc(memo_mask + 1, sizeof(*memo));
+  size_t arena_len = 0, arena_cap = 1024;
+  zdd_id_t *arena = malloc(sizeof(*arena) * arena_cap);
+  zdd_id_t tuple_hash(const zdd_id_t *a, int n) {
+    zdd_id_t h = n;
+    for(int i = 0; i < n; i++) h = (h ^ a[i]) * 0x9e3779b1u;
+    return h ^ (h >> 15);
+  }
+  struct memo_s *memo_at(const zdd_id_t *a, int n) {
+    zdd_id_t i = tuple_hash(a, n) & memo_mask;
+    for(; memo[i].n; i = (i + 1) & memo_mask) {
+      if (memo[i].n == n &&
+	  !memcmp(arena + memo[i].key, a, sizeof(*a) * n)) break;
+    }
+    return memo + i;
+  }
+  void memo_put(const zdd_id_t *a, int n, zdd_id_t r) {
+    if (arena_len + n > arena_cap) {
+      while (arena_len + n > arena_cap) arena_cap *= 2;
+      arena = realloc(arena, sizeof(*arena) * arena_cap);
+      if (!arena) die("out of memory");
+    }
+    struct memo_s *e = memo_at(a, n);
+    memcpy(arena + arena_len, a, sizeof(*a) * n);
+    e->key = arena_len;
+    e->n = n;
+    e->r = r;
+    arena_len += n;
+    if (2 * ++memo_count <= memo_mask) return;
+    struct memo_s *old = memo;
+    zdd_id_t oldmask = memo_mask;
+    memo_mask = 2 * memo_mask + 1;
+    memo = calloc(memo_mask + 1, sizeof(*memo));
+    if (!memo) die("out of memory");
+    for(zdd_id_t j = 0; j <= oldmask; j++) {
+      if (!old[j].n) continue;
+      zdd_id_t k = tuple_hash(arena + old[j].key, old[j].n) & memo_mask;
+      while (memo[k].n) k = (k + 1) & memo_mask;
+      memo[k] = old[j];
+    }
+    free(old);
+  }
+  // Prepares the tuple a of *n operands as above. Returns 1 if that settles
+  // it, with the result in r; otherwise *tag says whether the result gets
+  // the empty set toggled.
+  zdd_id_t r = 0;
+  int prepare(zdd_id_t *a, int *pn, char *tag) {
+    int n = *pn;
+    *tag = 1;
+    if (cbit) for(int i = 0; i < n; i++) {
+      *tag &= has_empty(a[i]);
+      a[i] = 1 == a[i] ? 0 : idx(a[i]);
+    } else *tag = 0;
+    for(;;) {
+      uint32_t s = 0;
+      for(int i = 0; i < n; i++) {
+	if (!a[i]) {
+	  r = *tag ? neg(0) : 0;
+	  return 1;
+	}
+	if (pool_t[a[i]] > s) s = pool_t[a[i]];
+      }
+      int moved = 0;
+      for(int i = 0; i < n; i++) {
+	if (pool_v[a[i]] < s) a[i] = pool_lo[a[i]], moved = 1;
+      }
+      if (!moved) break;
+    }
+    // Insertion sort, dropping duplicates: tuples are short, and children
+    // of a sorted tuple are mostly still in order.
+    int k = 1;
+    for(int i = 1; i < n; i++) {
+      zdd_id_t x = a[i];
+      int j = k;
+      while (j && a[j - 1] > x) j--;
+      if (j && a[j - 1] == x) continue;
+      memmove(a + j + 1, a + j, sizeof(*a) * (k - j));
+      a[j] = x;
+      k++;
+    }
+    *pn = n = k;
+    if (1 == n) {
+      r = *tag ? neg(a[0]) : a[0];
+      return 1;
+    }
+    struct memo_s *e = 2 == n ? 0 : memo_at(a, n);
+    if (2 == n ? cache_get(&r, OP_INTERSECTION, a[0], a[1]) : e->n) {
+      if (e) r = e->r;
+      if (*tag) r = neg(r);
+      return 1;
+    }
+    return 0;
+  }
+  // Depth-first with an explicit stack, one frame per level, grown as the
+  // tuples go deeper. Each frame keeps its key in buf, since prepare()
+  // rearranges a tuple in place, and the LO and HI tuples it passes on:
+  // count entries each. A frame's own tuple is its parent's LO or HI tuple,
+  // as the parent's state says.
+  struct frame_s {
+    uint32_t s, m;
+    int n;
+    // 0: new tuple, 1: LO result pending, 2: HI result pending.
+    char state;
+    char tag;
+    zdd_id_t lo;
+  } *stk = NULL;
+  zdd_id_t *buf = NULL;
+  int cap = 0, sp = 0;
+  void grow() {
+    cap = cap ? 2 * cap : 64;
+    stk = realloc(stk, sizeof(*stk) * cap);
+    buf = realloc(buf, sizeof(*buf) * 3 * count * cap);
+    if (!stk || !buf) die("out of memory");
+  }
+  zdd_id_t *top = malloc(sizeof(*top) * count);
+  for(int i = 0; i < count; i++) {
+    top[i] = (zdd_id_t) (uintptr_t) darray_at(stack, base + i);
+  }
+  grow();
+  stk[0].state = 0;
+  while (sp >= 0) {
+    struct frame_s *f = stk + sp;
+    zdd_id_t *key = buf + 3 * count * sp, *lo = key + count, *hi = lo + count;
+    if (0 == f->state) {
+      zdd_id_t *a = sp ? key - 3 * count + count * f[-1].state : top;
+      int n = sp ? f[-1].n : count;
+      if (prepare(a, &n, &f->tag)) {
+	sp--;
+	continue;
+      }
+      uint32_t s = 0, m = ~0;
+      for(int i = 0; i < n; i++) {
+	if (pool_t[a[i]] > s) s = pool_t[a[i]];
+	if (pool_v[a[i]] < m) m = pool_v[a[i]];
+      }
+      for(int i = 0; i < n; i++) {
+	int t = pool_v[a[i]] == m;
+	key[i] = a[i];
+	lo[i] = t ? pool_lo[a[i]] : a[i];
+	hi[i] = t ? pool_hi[a[i]] : a[i];
       }
-      return freenode++;
-    }
-    return (uint32_t) memo_it_data(it);
-  }
-
-  uint32_t instantiate(memo_it it) {
-    node_template_ptr t = (node_template_ptr) memo_it_data(it);
-    // Return if already converted to node.
-    if (!t->lo) return t->n;
-    // Recurse on LO, HI edges.
-    uint32_t lo = instantiate(t->lo);
-    uint32_t hi = instantiate(t->hi);
-    // Remove HI edges pointing to FALSE.
-    if (!hi) {
-      t->lo = NULL;
-      t->n = lo;
-      return lo;
-    }
-    // Convert to node.
-    uint32_t r = unique(t->v, lo, hi);
-    t->lo = NULL;
-    t->n = r;
-    return r;
-  }
-
-  insert_template(z0, z1);
-  freenode = z0;  // Overwrite input trees.
-  //memo_forall(tab, dump);
-  uint32_t key[2];
-  key[0] = z0;
-  key[1] = z1;
-  memo_it it = memo_it_at_u(tab, (void *) key, 8);
-  uint32_t root = instantiate(it);
-  // TODO: What if the intersection is node 0 or 1?
-  if (root <= 1) {
-    die("root is 0 or 1!");
-  }
-  if (root < z0) {
-    *pool[z0] = *pool[root];
-  } else if (root > z0)  {
-    pool_swap(z0, root);
-  }
-  void clear_it(void* data, const char* key) {
-    node_template_ptr t = (node_template_ptr) data;
-    uint32_t *k = (uint32_t *) key;
-    if (k[0] == k[1] && t != top && t != bot) free(t);
-  }
-  memo_forall(tab, clear_it);
-  memo_clear(tab);
-
-  for(uint16_t v = 1; v <= vmax; v++) memo_clear(node_tab[v]);
-  return z0;
+      f->n = n;
+      f->s = s;
+      f->m = m;
+      f->state = 1;
+    } else if (1 == f->state) {
+      f->lo = r;
+      f->state = 2;
+    } else {
+      r = unique(f->s, f->m, f->lo, r);
+      if (2 == f->n) cache_put(OP_INTERSECTION, key[0], key[1], r);
+      else memo_put(key, f->n, r);
+      if (f->tag) r = neg(r);
+      sp--;
+      continue;
+    }
+    // On to the LO or HI tuple.
+    if (++sp == cap) grow();
+    stk[sp].state = 0;
+  }
+  free(top);
+  free(stk);
+  free(buf);
+  free(arena);
+  free(memo);
+  while (darray_count(stack) > base + 1) darray_remove_last(stack);
+  return zdd_set_root(r);
 }
 
 void zdd_check() {
+  // Only live nodes need be canonical.
+  zdd_gc();
   memo_t node_tab;
   memo_init(node_tab);
-  for (uint32_t i = 2; i < freenode; i++) {
+  for (zdd_id_t i = 2; i < freenode; i++) {
     memo_it it;
-    uint32_t key[3];
-    key[0] = pool[i]->lo;
-    key[1] = pool[i]->hi;
-    key[2] = pool[i]->v;
-    if (!memo_it_insert_u(&it, node_tab, (void *) key, 12)) {
-      printf("duplicate: %d %d\n", i, (int) it->data);
+    zdd_id_t key[4];
+    key[0] = pool_lo[i];
+    key[1] = pool_hi[i];
+    key[2] = pool_v[i];
+    key[3] = pool_t[i];
+    if (!memo_it_insert_u(&it, node_tab, (void *) key, sizeof(key))) {
+      printf("duplicate: %lu %lu\n", (unsigned long) i,
+	     (unsigned long) (uintptr_t) it->data);
     } else {
-      it->data = (void *) i;
+      it->data = (void *) (uintptr_t) i;
+    }
+    if (!pool_hi[i]) {
+      printf("HI -> FALSE: %lu\n", (unsigned long) i);
     }
-    if (!pool[i]->hi) {
-      printf("HI -> FALSE: %d\n", i);
+    if (i == pool_lo[i]) {
+      printf("LO self-loop: %lu\n", (unsigned long) i);
     }
-    if (i == pool[i]->lo) {
-      printf("LO self-loop: %d\n", i);
+    if (i == pool_hi[i]) {
+      printf("HI self-loop: %lu\n", (unsigned long) i);
     }
-    if (i == pool[i]->hi) {
-      printf("HI self-loop: %d\n", i);
+    if (chains && pool_lo[i] == pool_hi[i] &&
+        pool_t[pool_lo[i]] == pool_v[i] + 1) {
+      printf("unmerged chain: %lu\n", (unsigned long) i);
+    }
+    if (cbit && has_empty(pool_lo[i])) {
+      printf("LO holds empty set: %lu\n", (unsigned long) i);
     }
   }
   memo_clear(node_tab);
 }
 
 void zdd_init() {
+  char *s = getenv("ZDD_POOL_MAX");
+  if (s) zdd_set_pool_max(strtoull(s, NULL, 0));
+  pool_reserve();
+  pool_need(1);
   // Initialize TRUE and FALSE nodes.
-  pool[0]->v = ~0;
-  pool[0]->lo = 0;
-  pool[0]->hi = 0;
-  pool[1]->v = ~0;
-  pool[1]->lo = 1;
-  pool[1]->hi = 1;
+  set_node(0, ~0, ~0, 0, 0);
+  set_node(1, ~0, ~0, 1, 1);
   freenode = 2;
   darray_init(stack);
+  utab_alloc(1 << 16);
+  // Lets any program compare the engines without recompiling.
+  s = getenv("ZDD_ENGINE");
+  if (s && !strcmp(s, "bfs")) engine = ZDD_BFS;
+  s = getenv("ZDD_THREADS");
+  if (s) zdd_set_threads(atoi(s));
+  s = getenv("ZDD_CHAINS");
+  if (s) zdd_set_chains(atoi(s));
+  s = getenv("ZDD_COMPLEMENT");
+  if (s) zdd_set_complement(atoi(s));
+  s = getenv("ZDD_REORDER");
+  if (s) zdd_set_reorder(strtoull(s, NULL, 0));
+  s = getenv("ZDD_SCHEDULE_LOG");
+  if (s) zdd_set_schedule_log(atoi(s));
 }
 
 void zdd_dump() {
-  for(uint32_t i = (uint32_t) darray_last(stack); i < freenode; i++) {
-    printf("I%d: !%d ? %d : %d\n", i, pool[i]->v, pool[i]->lo, pool[i]->hi);
+  zdd_id_t r = idx(zdd_root());
+  char *mark = mark_from(2, r);
+  // Complemented edges are marked with a tilde.
+  if (zdd_root() & cbit) printf("root: ~%lu\n", (unsigned long) r);
+  for(zdd_id_t i = r; i >= 2 && r >= 2; i--) {
+    if (!mark[i - 2]) continue;
+    printf("I%lu: ", (unsigned long) i);
+    if (pool_t[i] != pool_v[i]) printf("%u..%u free, ", pool_t[i], pool_v[i] - 1);
+    printf("!%u ? %lu : %s%lu\n", pool_v[i], (unsigned long) pool_lo[i],
+	   pool_hi[i] & cbit ? "~" : "", (unsigned long) idx(pool_hi[i]));
   }
+  free(mark);
 }
 
-uint32_t zdd_powerset() {
+zdd_id_t zdd_powerset() {
   vmax_check();
-  uint16_t r = zdd_next_node();
   zdd_push();
-  for(int v = 1; v < vmax; v++) zdd_add_node(v, 1, 1);
-  zdd_add_node(vmax, -1, -1);
-  return r;
+  if (chains) {
+    // A single node frees every variable.
+    pool_need(freenode);
+    set_node(freenode++, 1, vmax, 1, 1);
+  } else {
+    for(int v = 1; v < vmax; v++) zdd_add_node(v, 1, 1);
+    zdd_add_node(vmax, -1, -1);
+  }
+  return zdd_root();
+}
+
+// Hands the set of levels v[0..count-1] to fn as variables in ascending
+// order, using buf if the order is not the identity.
+static void report(void (*fn)(int *, int), int *v, int count, int *buf) {
+  if (!reordered) {
+    fn(v, count);
+    return;
+  }
+  for(int i = 0; i < count; i++) buf[i] = lvl_var[v[i]];
+  int cmp(const void *p, const void *q) {
+    return *(const int *) p - *(const int *) q;
+  }
+  qsort(buf, count, sizeof(*buf), cmp);
+  fn(buf, count);
 }
 
 void zdd_forall(void (*fn)(int *, int)) {
   vmax_check();
-  int v[vmax], vcount = 0;
-  void recurse(uint32_t p) {
-    if (!p) return;
-    if (1 == p) {
-      fn(v, vcount);
-      return;
+  // Depth-first with an explicit stack. Variables strictly increase down the
+  // stack, so it never holds more than vmax + 1 frames, plus a sink.
+  // A frame stands for node p from variable u on: while u is one of the
+  // free variables of p, both branches lead to p again from u + 1.
+  int *v = malloc(sizeof(*v) * vmax), vcount = 0;
+  int *buf = malloc(sizeof(*buf) * vmax);
+  struct frame_s {
+    zdd_id_t p;
+    uint32_t u;
+    // 0: visit LO, 1: visit HI, 2: done.
+    char state;
+  } *stk = malloc(sizeof(*stk) * (vmax + 2));
+  int sp = -1;
+  void push(zdd_id_t p, uint32_t u) {
+    sp++;
+    stk[sp].p = p;
+    stk[sp].u = u;
+    stk[sp].state = 0;
+  }
+  // Enters the family an edge leads to. A complemented edge holds the empty
+  // set on top, which comes first, just as a LO path to TRUE would.
+  void enter(zdd_id_t e) {
+    if (e & cbit) report(fn, v, vcount, buf);
+    push(idx(e), pool_t[idx(e)]);
+  }
+  enter(zdd_root());
+  while (sp >= 0) {
+    struct frame_s *f = stk + sp;
+    zdd_id_t p = f->p;
+    uint32_t u = f->u;
+    if (p <= 1) {
+      if (p) report(fn, v, vcount, buf);
+      sp--;
+      continue;
+    }
+    int dc = u < pool_v[p];
+    switch(f->state++) {
+      case 0:
+	if (dc) push(p, u + 1);
+	else if (pool_lo[p]) enter(pool_lo[p]);
+	break;
+      case 1:
+	v[vcount++] = u;
+	if (dc) push(p, u + 1);
+	else enter(pool_hi[p]);
+	break;
+      default:
+	vcount--;
+	sp--;
+	break;
     }
-    if (zdd_lo(p)) recurse(zdd_lo(p));
-    v[vcount++] = zdd_v(p);
-    recurse(zdd_hi(p));
-    vcount--;
   }
-  recurse(zdd_root());
+  free(stk);
+  free(v);
+  free(buf);
 }
 
 void zdd_forlargest(void (*fn)(int *, int)) {
   vmax_check();
-  uint32_t r = zdd_root(), s = zdd_next_node() - r;
+  zdd_id_t *list, *pos;
+  zdd_id_t r = zdd_root(), s = topo(idx(r), &list, &pos);
   char *choice = malloc(sizeof(*choice) * s);
-  memset(choice, -1, s);
   int *score = malloc(sizeof(*score) * s);
-  int v[vmax], vcount = 0;
-
-  int recurse(uint32_t p) {
-    if (1 >= p) return 0;
-    if (choice[p - r] >= 0) return score[p - r];
+  int *v = malloc(sizeof(*v) * vmax), vcount = 0;
+  score[0] = score[1] = 0;
+  // Bottom-up, so children are scored before their parents.
+  // Free variables are always worth taking.
+  for(zdd_id_t k = 2; k < s; k++) {
+    zdd_id_t p = list[k];
+    int d = pool_v[p] - pool_t[p];
     if (1 >= zdd_lo(p)) {
       // In this case, definitely better off including p in our set.
-      choice[p - r] = 1;
-      return score[p - r] = 1 + recurse(zdd_hi(p));
+      choice[k] = 1;
+      score[k] = d + 1 + score[pos[idx(zdd_hi(p))]];
+      continue;
     }
-    int m = recurse(zdd_lo(p));
-    int n = recurse(zdd_hi(p)) + 1;
+    // The empty set a complemented edge adds never makes a set larger.
+    int m = d + score[pos[zdd_lo(p)]];
+    int n = d + score[pos[idx(zdd_hi(p))]] + 1;
     // Replace condition with m <= n to find lexicographically last set of
     // maximum size. At the moment it finds the lexicographically first.
     // We could also detect m == n and assign choice[p] = 2, so we could later
     // iterate through all largest sets.
     if (m < n) {
-      choice[p - r] = 1;
-      return score[p - r] = n;
+      choice[k] = 1;
+      score[k] = n;
+    } else {
+      choice[k] = 0;
+      score[k] = m;
     }
-    choice[p - r] = 0;
-    return score[p - r] = m;
   }
-  printf("max set: %d\n", recurse(r));
-  for(uint32_t p = r; p > 1;
-      p = !choice[p - r] ? zdd_lo(p) : (v[vcount++] = zdd_v(p), zdd_hi(p)));
-  fn(v, vcount);
+  printf("max set: %d\n", score[pos[idx(r)]]);
+  for(zdd_id_t p = idx(r); p > 1;
+      p = idx(!choice[pos[p]] ? zdd_lo(p) : (v[vcount++] = zdd_v(p), zdd_hi(p)))) {
+    for(uint32_t u = pool_t[p]; u < pool_v[p]; u++) v[vcount++] = u;
+  }
+  int *buf = malloc(sizeof(*buf) * vmax);
+  report(fn, v, vcount, buf);
+  free(buf);
   free(choice);
   free(score);
+  free(list);
+  free(pos);
+  free(v);
 }
 
-uint16_t zdd_vmax() {
+uint32_t zdd_vmax() {
   vmax_check();
   return vmax;
 }
 
-uint32_t zdd_size() {
-  return zdd_next_node() - zdd_root() + 2;
+zdd_id_t zdd_size() {
+  zdd_id_t r = idx(zdd_root()), n = 2;
+  if (r < 2) return n;
+  char *mark = mark_from(2, r);
+  for(zdd_id_t i = 0; i <= r - 2; i++) n += mark[i];
+  free(mark);
+  return n;
+}
+
+// The builders below work in levels, and take sorted lists of them. The
+// public versions translate lists of variables first. Builders that need a
+// number besides the list get it as n; the rest ignore it.
+static void with_levels(const int *a, int count, int n,
+                        void (*build)(const int *, int, int)) {
+  if (!reordered) {
+    build(a, count, n);
+    return;
+  }
+  int *l = malloc(sizeof(*l) * (count + 1));
+  for(int i = 0; i < count; i++) l[i] = var_lvl[a[i]];
+  int cmp(const void *p, const void *q) {
+    return *(const int *) p - *(const int *) q;
+  }
+  qsort(l, count, sizeof(*l), cmp);
+  build(l, count, n);
+  free(l);
 }
 
 // Construct ZDD of sets containing exactly 1 of the elements in the given list.
 // Zero suppression means we must treat sequences in the list carefully.
-void zdd_contains_exactly_1(const int *a, int count) {
+static void exactly_1(const int *a, int count, int unused) {
   vmax_check();
   zdd_push();
   int v = 1;
@@ -517,8 +3232,8 @@ void zdd_contains_exactly_1(const int *a, int count) {
       // Find length of consecutive sequence.
       int k;
       for(k = 0; i + k < count && v + k == a[i + k]; k++);
-      uint32_t n = zdd_next_node();
-      uint32_t h = v + k > vmax ? 1 : n + k + (count != i + k);
+      zdd_id_t n = zdd_next_node();
+      zdd_id_t h = v + k > vmax ? 1 : n + k + (count != i + k);
       if (i >= 1) {
 	// In the middle of the list: must fix previous node; we reach said node
 	// if we've seen an element in the list already, in which case the
@@ -555,17 +3270,17 @@ void zdd_contains_exactly_1(const int *a, int count) {
     }
   }
   // Fix last node.
-  uint32_t last = zdd_last_node();
+  zdd_id_t last = zdd_last_node();
   if (zdd_lo(last) > last) zdd_set_lo(last, 1);
   if (zdd_hi(last) > last) zdd_set_hi(last, 1);
 }
 
 // Construct ZDD of sets containing at most 1 of the elements in the given
 // list.
-void zdd_contains_at_most_1(const int *a, int count) {
+static void at_most_1(const int *a, int count, int unused) {
   vmax_check();
   zdd_push();
-  uint32_t n = zdd_last_node();
+  zdd_id_t n = zdd_last_node();
   // Start with ZDD of all sets.
   int v = 1;
   while(v < vmax) {
@@ -581,10 +3296,10 @@ void zdd_contains_at_most_1(const int *a, int count) {
   // then rejoin.
   v = a[0];
 
-  uint32_t n1 = zdd_next_node();
+  zdd_id_t n1 = zdd_next_node();
   zdd_set_hi(n + v, n1);
   v++;
-  uint32_t last = 0;
+  zdd_id_t last = 0;
   for(int i = 1; i < count; i++) {
     int v1 = a[i];
     while(v < v1) {
@@ -604,7 +3319,8 @@ void zdd_contains_at_most_1(const int *a, int count) {
   if (vmax < v) {
     // Special case: list ends with vmax. Especially troublesome if there's
     // a little sequence, e.g. vmax - 2, vmax - 1, vmax.
-    for(v = vmax; zdd_hi(n + v) > n + vmax; v--) {
+    // Stop before n itself, which may be any node, even a tagged one.
+    for(v = vmax; v && zdd_hi(n + v) > n + vmax; v--) {
       zdd_set_hi(n + v, 1);
     }
     // The following line is only needed if we added any nodes to the branch,
@@ -620,10 +3336,10 @@ void zdd_contains_at_most_1(const int *a, int count) {
 
 // Construct ZDD of sets containing at least 1 of the elements in the given
 // list.
-void zdd_contains_at_least_1(const int *a, int count) {
+static void at_least_1(const int *a, int count, int unused) {
   vmax_check();
   zdd_push();
-  uint32_t n = zdd_last_node();
+  zdd_id_t n = zdd_last_node();
   // Start with ZDD of all sets.
   int v = 1;
   while(v < vmax) {
@@ -639,7 +3355,7 @@ void zdd_contains_at_least_1(const int *a, int count) {
     return;
   }
 
-  uint32_t n1 = zdd_next_node();
+  zdd_id_t n1 = zdd_next_node();
   zdd_set_lo(n + v, n1);
   v++;
   for(int i = 1; i < count; i++) {
@@ -656,19 +3372,26 @@ void zdd_contains_at_least_1(const int *a, int count) {
 
 // Construct ZDD of sets not containing any elements from the given list.
 // Assumes not every variable is on the list.
-void zdd_contains_0(const int *a, int count) {
+static void contains_0(const int *a, int count, int unused) {
   vmax_check();
   zdd_push();
   int i = 1;
   int v1 = count ? a[0] : -1;
+  int added = 0;
   for(int v = 1; v <= vmax; v++) {
     if (v1 == v) {
       v1 = i < count ? a[i++] : -1;
     } else {
       zdd_add_node(v, 1, 1);
+      added = 1;
     }
   }
-  uint32_t n = zdd_last_node();
+  // With every variable excluded, only the empty set is left.
+  if (!added) {
+    zdd_set_root(1);
+    return;
+  }
+  zdd_id_t n = zdd_last_node();
   zdd_set_lo(n, 1);
   zdd_set_hi(n, 1);
 }
@@ -692,10 +3415,23 @@ void zdd_contains_0(const int *a, int count) {
 // and so on until vmax --- F, vmax ... T.
 void zdd_1_per_interval(const int* list, int count) {
   vmax_check();
+  if (reordered) {
+    // The intervals are scattered over the levels: intersect one exactly-1
+    // constraint per interval instead.
+    int *a = malloc(sizeof(*a) * vmax);
+    for(int k = 0; k < count; k++) {
+      int end = k + 1 < count ? list[k + 1] : (int) vmax + 1;
+      for(int v = list[k]; v < end; v++) a[v - list[k]] = v;
+      zdd_contains_exactly_1(a, end - list[k]);
+      if (k) zdd_intersection();
+    }
+    free(a);
+    return;
+  }
   zdd_push();
   // Check list[0] is 1.
   int i = 0;
-  uint32_t n = zdd_last_node();
+  zdd_id_t n = zdd_last_node();
   int get() {
     i++;
     //return i < inta_count(a) ? inta_at(a, i) : -1;
@@ -713,20 +3449,19 @@ void zdd_1_per_interval(const int* list, int count) {
 
 // Construct ZDD of sets containing exactly n of the elements in the
 // given list.
-void zdd_contains_exactly_n(int n, const int *a, int count) {
+static void exactly_n(const int *a, int count, int n) {
   zdd_push();
   if (n > count) {
     die("unhandled special case (should return empty family");
   }
   // Lookup table for sub-ZDDs we construct recursively.
-  uint32_t tab[count][n + 1];
-  memset(tab, 0, count * (n + 1) * sizeof(uint32_t));
-  uint32_t recurse(int i, int n) {
+  zdd_id_t (*tab)[n + 1] = calloc(count ? count : 1, sizeof(*tab));
+  zdd_id_t recurse(int i, int n) {
     // The outermost invocation is a special case, as other invocations
     // assume part of the ZDD has already been built. We have i == -1
     // during this special case.
     int v = -1 == i ? 1 : a[i] + 1;
-    uint32_t root;
+    zdd_id_t root;
     if (i == count - 1) {
       // Base case: finish off the ZDD with everything leading to TRUE.
       // We can reach here even in the first invocation of recurse(); this
@@ -751,13 +3486,13 @@ void zdd_contains_exactly_n(int n, const int *a, int count) {
       if (is_empty) {
 	root = recurse(i + 1, n);
       } else {
-	uint32_t last = zdd_last_node();
+	zdd_id_t last = zdd_last_node();
 	zdd_set_hilo(last, recurse(i + 1, n));
       }
       if (-1 != i) tab[i][n] = root;
       return root;
     }
-    uint32_t last = zdd_add_node(v, 0, 0);
+    zdd_id_t last = zdd_add_node(v, 0, 0);
     // If we include this variable, then that's one down, n - 1 more to go
     // in the remaining.
     zdd_set_hi(last, recurse(i + 1, n - 1));
@@ -770,4 +3505,25 @@ void zdd_contains_exactly_n(int n, const int *a, int count) {
     return root;
   }
   recurse(-1, n);
+  free(tab);
+}
+
+void zdd_contains_exactly_1(const int *a, int count) {
+  with_levels(a, count, 0, exactly_1);
+}
+
+void zdd_contains_at_most_1(const int *a, int count) {
+  with_levels(a, count, 0, at_most_1);
+}
+
+void zdd_contains_at_least_1(const int *a, int count) {
+  with_levels(a, count, 0, at_least_1);
+}
+
+void zdd_contains_0(const int *a, int count) {
+  with_levels(a, count, 0, contains_0);
+}
+
+void zdd_contains_exactly_n(int n, const int *a, int count) {
+  with_levels(a, count, n, exactly_n);
 }
@@ -1,6 +1,14 @@
 #include <stdint.h>
 #include <gmp.h>
 
+// Node index. Build with -DZDD_64 (make ZDD64=1) for ZDDs of more than 2^31
+// nodes, at the cost of twice the memory per node.
+#ifdef ZDD_64
+typedef uint64_t zdd_id_t;
+#else
+typedef uint32_t zdd_id_t;
+#endif
+
 // Usage:
 // 1. Call zdd_init() first.
 // 2. Call zdd_set_vmax() with the number of variables (number of elements).
@@ -13,32 +21,106 @@
 // 5. Now it depends on the application. For a puzzle solver, there is
 //    typically a unique solution which can be read by traversing the HI edges:
 //      for(i = zdd_root; i != 1; i = zdd_hi(i)) {
-//        printf("%d\n", zdd_v(i)); 
+//        printf("%d\n", zdd_var(zdd_v(i)));
 //      }
 //    Or compute statistics on the family of sets with zdd_count() and friends.
 
 void zdd_init();
+// Cap the number of nodes; the default is 2^31 - 1, or 2^39 - 1 with ZDD_64.
+// Memory is only committed as the pool fills, so the cap mostly guards against
+// runaway growth. Must be called before zdd_init(), or set ZDD_POOL_MAX in
+// the environment.
+void zdd_set_pool_max(zdd_id_t n);
 void zdd_check();
-uint16_t zdd_vmax();
-uint16_t zdd_set_vmax(int i);
+// Choose how zdd_intersection() traverses its operands: depth-first (the
+// default), or breadth-first, one variable at a time. Setting the
+// environment variable ZDD_ENGINE to "bfs" before zdd_init() picks the latter.
+enum { ZDD_DFS, ZDD_BFS };
+void zdd_set_engine(int e);
+// By default a node may stand for a run of variables that are each free to
+// be in or out of a set, followed by an ordinary test (Bryant's chain
+// reduction). Then a constraint on a few variables needs only a few nodes,
+// however many variables there are. Programs that walk nodes one variable at
+// a time with zdd_lo() and zdd_hi() should call zdd_set_chains(0) before
+// making any nodes, or set ZDD_CHAINS=0 in the environment. Dies if a ZDD is
+// still on the stack or held by a handle.
+void zdd_set_chains(int on);
+// Complement edges, after Minato: a HI edge or root may carry a tag that
+// toggles the empty set in the family it leads to, so a family and the same
+// family with or without the empty set share every node. Turns chains off;
+// the two do not mix. Same rules as zdd_set_chains(), and ZDD_COMPLEMENT in
+// the environment also sets it in zdd_init(). A tagged id is still accepted
+// by zdd_v(), zdd_lo() and zdd_hi(), and zdd_lo() passes the tag on.
+void zdd_set_complement(int on);
+// Meld on n threads, with work stealing. Running workers are stopped if n
+// differs, and new ones start with the next meld. ZDD_THREADS in the
+// environment also sets it in zdd_init().
+void zdd_set_threads(int n);
+int zdd_threads();
+uint32_t zdd_vmax();
+// Also restores the identity variable order. If the order has changed, or
+// vmax shrinks, dies if a ZDD is still on the stack or held by a handle, as
+// zdd_set_chains() does.
+uint32_t zdd_set_vmax(int i);
+// Variable order. Nodes test levels rather than variables: zdd_var() gives
+// the variable at a level and zdd_level() the level of a variable. Both are
+// the identity until the order changes, so zdd_v() is then the variable.
+// zdd_forall() and the zdd_contains_* builders speak in variables
+// throughout, but nodes built by hand must be given levels.
+uint32_t zdd_var(uint32_t level);
+uint32_t zdd_level(uint32_t var);
+// Sift every variable to the level that minimizes the live nodes, after
+// Rudell, and return the number of nodes in the pool afterwards. Nodes keep
+// their families, so roots and handles stay valid. Needs chains and
+// complement edges off.
+zdd_id_t zdd_reorder();
+// Swap the variables at levels level and level + 1.
+void zdd_swap(uint32_t level);
+// Sift automatically in zdd_intersection() once the pool holds threshold
+// nodes, and again whenever it doubles since; 0, the default, never does.
+// Turns chains and complement edges off, with the same rules as
+// zdd_set_chains(). ZDD_REORDER in the environment also sets it in
+// zdd_init(). Programs that build nodes by hand should call
+// zdd_set_reorder(0).
+void zdd_set_reorder(zdd_id_t threshold);
 // Call before computing a new ZDD on the stack.
 void zdd_push();
 void zdd_pop();
+// Reduce the ZDD built by hand on top of the stack to canonical form, in
+// linear time, and return its root. This happens anyway as soon as anything
+// reads the ZDD, such as zdd_push() or zdd_intersection(), so builders need
+// not call it.
+zdd_id_t zdd_reduce();
+// Handles keep ZDDs alive independently of the stack, so a ZDD can be reused
+// without rebuilding it. zdd_keep() returns a handle to the ZDD on top of the
+// stack, with a reference count of 1, and leaves the stack alone.
+// zdd_load() pushes a copy of it; no nodes are copied. Operations never
+// destroy their operands: unreachable nodes linger until the next garbage
+// collection, which happens automatically, or on calling zdd_gc(). A
+// collection also lays the survivors out in depth-first order, so calling
+// zdd_gc() before heavy counting or enumeration can speed it up.
+int zdd_keep();
+void zdd_load(int h);
+void zdd_ref(int h);
+void zdd_release(int h);
+void zdd_gc();
 // Print all nodes.
 void zdd_dump();
-// Getters and setters.
-uint32_t zdd_v(uint32_t n);
-uint32_t zdd_lo(uint32_t n);
-uint32_t zdd_hi(uint32_t n);
-uint32_t zdd_root();
-uint32_t zdd_set_hi(uint32_t n, uint32_t hi);
-uint32_t zdd_set_lo(uint32_t n, uint32_t lo);
-uint32_t zdd_set_hilo(uint32_t n, uint32_t hilo);
-uint32_t zdd_set_root(uint32_t root);
-uint32_t zdd_add_node(uint32_t v, int offlo, int offhi);
-uint32_t zdd_abs_node(uint32_t v, uint32_t lo, uint32_t hi);
-uint32_t zdd_last_node();
-uint32_t zdd_next_node();
+// Getters and setters. Variables zdd_top(n) to zdd_v(n) - 1 are free, then
+// the LO and HI edges are taken according to variable zdd_v(n).
+uint32_t zdd_v(zdd_id_t n);
+uint32_t zdd_top(zdd_id_t n);
+zdd_id_t zdd_lo(zdd_id_t n);
+zdd_id_t zdd_hi(zdd_id_t n);
+zdd_id_t zdd_root();
+zdd_id_t zdd_set_hi(zdd_id_t n, zdd_id_t hi);
+zdd_id_t zdd_set_lo(zdd_id_t n, zdd_id_t lo);
+zdd_id_t zdd_set_hilo(zdd_id_t n, zdd_id_t hilo);
+zdd_id_t zdd_set_root(zdd_id_t root);
+zdd_id_t zdd_add_node(uint32_t v, int offlo, int offhi);
+zdd_id_t zdd_abs_node(uint32_t v, zdd_id_t lo, zdd_id_t hi);
+zdd_id_t zdd_last_node();
+zdd_id_t zdd_next_node();
 // Count number of sets in ZDD.
 void zdd_count(mpz_ptr);
 // Count number of sets in ZDD, as well as sum of sizes of all sets.
@@ -48,12 +130,12 @@ void zdd_count_1(mpz_ptr z0, mpz_ptr z1);
 // of their squares. (The 0-, 1- and 2- power sums.)
 void zdd_count_2(mpz_ptr z0, mpz_ptr z1, mpz_ptr z2);
 // Returns number of nodes.
-uint32_t zdd_size();
+zdd_id_t zdd_size();
 
 // Need to have set vmax to call these:
 
-// Constructs ZDD of all sets.
-uint32_t zdd_powerset();
+// Constructs ZDD of all sets, and returns its root, as zdd_root() would.
+zdd_id_t zdd_powerset();
 
 // Runs callback on every set in ZDD.
 void zdd_forall(void (*fn)(int *, int));
@@ -80,5 +162,74 @@ void zdd_contains_0(const int *a, int count);
 // given list.
 void zdd_contains_exactly_n(int n, const int *a, int count);
 
+// Construct ZDD of sets containing exactly 1 element for each interval
+// [a_k, a_{k+1}) in the given list, which must start with 1. The last
+// interval ends at vmax.
+void zdd_1_per_interval(const int *list, int count);
+
 // Replace top two ZDDs on the stack with their intersection.
-uint32_t zdd_intersection();
+zdd_id_t zdd_intersection();
+// Likewise with their union, the family second from the top less the one on
+// top, and their symmetric difference. These recurse on one thread whatever
+// the engine, and share the unique table and computed table with it.
+zdd_id_t zdd_union();
+zdd_id_t zdd_difference();
+zdd_id_t zdd_symdiff();
+// Knuth's family algebra on the top two ZDDs, f below g: the join holds every
+// union of a set of f with a set of g, the meet every intersection and the
+// delta every symmetric difference. The quotient f / g holds the sets that
+// every set of g extends, disjointly, to a set of f; f / {} is empty. The
+// remainder is f minus the join of g and f / g.
+zdd_id_t zdd_join();
+zdd_id_t zdd_meet();
+zdd_id_t zdd_delta();
+zdd_id_t zdd_quotient();
+zdd_id_t zdd_remainder();
+// Likewise, the sets of f that are subsets of no set of g, supersets of no
+// set of g, subsets of some set of g, and supersets of some set of g.
+zdd_id_t zdd_nonsub();
+zdd_id_t zdd_nonsup();
+zdd_id_t zdd_subsets();
+zdd_id_t zdd_supersets();
+// Replace the ZDD on top of the stack with its maximal sets, those no other
+// set contains, or with its minimal sets, those that contain no other set.
+zdd_id_t zdd_maximal();
+zdd_id_t zdd_minimal();
+// Minato's cofactors of the ZDD on top of the stack by variable v: the sets
+// holding v, with v taken out (onset); the sets without v (offset); and every
+// set with v toggled (change).
+zdd_id_t zdd_onset(int v);
+zdd_id_t zdd_offset(int v);
+zdd_id_t zdd_change(int v);
+// Keep the sets of the ZDD on top of the stack that agree with a partial
+// assignment, in one pass: a positive lit[i] must be in the set, and a
+// negative one's variable -lit[i] must be out. Unlike zdd_onset(), assigned
+// variables stay in the sets, so a solved puzzle can be narrowed down to the
+// solutions with some cells fixed without solving it again.
+zdd_id_t zdd_assign(const int *lit, int count);
+// Replace the ZDD on top of the stack with its projection onto the given
+// variables: each set keeps only those of its elements in the list, and
+// sets that become equal merge. Counting and enumeration then see one set
+// per distinct pattern on the listed variables.
+zdd_id_t zdd_project(const int *a, int count);
+
+// Push the intersection of count constraints, where build(i) pushes the
+// i-th, and return its root. Neighbouring constraints are intersected
+// first, in a balanced tree. With zdd_set_threads(), each level of the tree
+// melds all its pairs at once, so independent subtrees share the workers.
+// Builders run in turn: they write the shared pool.
+zdd_id_t zdd_intersect_tree(int count, void (*build)(int i));
+// Replace the top count ZDDs with their intersection, and return its root.
+// The order is picked as it goes: each step intersects the pair with the
+// smallest predicted result, from their node counts, how many of the levels
+// where they branch they share, and how earlier, similar pairs turned out.
+zdd_id_t zdd_intersect_all(int count);
+// Nonzero makes zdd_intersect_all() print each choice, its estimate and the
+// actual result size to stderr. ZDD_SCHEDULE_LOG in the environment also
+// sets it in zdd_init().
+void zdd_set_schedule_log(int on);
+// Replace the top count ZDDs with their intersection, and return its root.
+// All of them are walked together in one pass, so unlike repeated
+// zdd_intersection() no intermediate result is built, and a branch stops as
+// soon as any operand rules it out. Runs on one thread.
+zdd_id_t zdd_intersect_n(int count);